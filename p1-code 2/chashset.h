@@ -0,0 +1,50 @@
+// chashset.h: header for the thread-safe hash set variant
+
+#ifndef CHASHSET_H
+#define CHASHSET_H 1
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "hashset.h"
+
+// Type for nodes of a concurrent hash set; each is one allocation
+// holding its key and is never moved or freed until the set is
+typedef struct chashnode {
+  struct chashnode *_Atomic next; // next node in the same bucket, NULL if last
+  int hash;                     // cached hash code of the key
+  int len;                      // strlen() of the key
+  char key[];                   // the key, '\0' terminated
+} chashnode_t;
+
+// Bucket array of a concurrent hash set; replaced, not changed in
+// size, when the set grows
+typedef struct chashtable {
+  struct chashtable *retired;   // table this one replaced, kept until the set is freed
+  int size;                     // number of buckets, a power of two
+  chashnode_t *_Atomic buckets[]; // heads of the bucket lists
+} chashtable_t;
+
+// Type of thread-safe hash set: any number of threads may call
+// chashset_add() and chashset_contains() at the same time
+typedef struct {
+  chashtable_t *_Atomic table;  // current bucket array
+  atomic_uint seq;              // odd while a resize is relinking nodes
+  atomic_int elem_count;        // number of elements in the set
+  int stripe_count;             // number of writer locks, a power of two
+  pthread_mutex_t *stripes;     // stripe i guards buckets whose index is i modulo stripe_count
+  hashfunc_t hashfunc;          // hash function used for every key
+  double max_load;              // add grows the table when the load would exceed this
+} chashset_t;
+
+#define CHASHSET_DEFAULT_STRIPES 64  // writer locks used when 0 is requested
+#define CHASHSET_MAX_LOAD 1.0        // load factor that triggers doubling the table
+
+// functions defined in chashset_funcs.c
+void  chashset_init(chashset_t *chs, int table_size, int stripes, hashfunc_t hashfunc);
+int   chashset_add(chashset_t *chs, char elem[]);
+int   chashset_contains(chashset_t *chs, char key[]);
+int   chashset_count(chashset_t *chs);
+int   chashset_table_size(chashset_t *chs);
+void  chashset_free_fields(chashset_t *chs);
+
+#endif
@@ -0,0 +1,187 @@
+// chashset_bench.c: multi-threaded throughput benchmark for the
+// concurrent hash set in chashset_funcs.c. Runs three phases:
+//
+// ingest : all threads add disjoint slices of the keys to a set that
+//          starts small, so it grows many times while being written
+// contains: for 1, 2, 4, ... up to the thread limit, each thread looks
+//          up random keys, half present and half absent
+// mixed  : one thread adds new keys, growing the table, while the
+//          others look up keys known to be present
+//
+// Lookups check their answers; any wrong answer is counted in the
+// 'errors' column, which must be 0.
+//
+// usage: ./chashset_bench [keys] [max_threads] [lookups_per_thread]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "chashset.h"
+
+#define KEY_WIDTH 16                   // bytes reserved for each generated key
+
+typedef struct {
+  chashset_t *chs;                     // set shared by all threads
+  char *keys;                          // keys[i*KEY_WIDTH] is "key<i>", i < nkeys
+  char *misses;                        // like keys but "miss<i>", never added
+  int first;                           // ingest: first key index this thread adds
+  int last;                            // ingest: one past the last key it adds
+  int nkeys;                           // keys eligible for lookups
+  long lookups;                        // lookups each reader makes
+  unsigned long seed;                  // per-thread random state
+  atomic_int *stop;                    // mixed: set when the writer is done
+  long done;                           // lookups actually made
+  long errors;                         // lookups with a wrong answer
+} worker_t;
+
+static double now(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long next_rand(unsigned long *state){
+  unsigned long x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x;
+}
+
+static void *ingest_thread(void *arg){
+  worker_t *w = arg;
+  for(int i = w->first; i < w->last; i++){
+    if(!chashset_add(w->chs, &w->keys[(long) i * KEY_WIDTH])){
+      w->errors++;
+    }
+  }
+  return NULL;
+}
+
+static void *contains_thread(void *arg){
+  worker_t *w = arg;
+  for(long n = 0; n < w->lookups; n++){
+    unsigned long r = next_rand(&w->seed);
+    long i = (r >> 1) % w->nkeys;
+    if(r & 1){
+      w->errors += !chashset_contains(w->chs, &w->keys[i * KEY_WIDTH]);
+    } else{
+      w->errors += chashset_contains(w->chs, &w->misses[i * KEY_WIDTH]);
+    }
+  }
+  w->done = w->lookups;
+  return NULL;
+}
+
+static void *reader_thread(void *arg){
+  worker_t *w = arg;
+  while(!atomic_load(w->stop)){
+    long i = next_rand(&w->seed) % w->nkeys;
+    w->errors += !chashset_contains(w->chs, &w->keys[i * KEY_WIDTH]);
+    w->done++;
+  }
+  return NULL;
+}
+
+static char *make_keys(char *prefix, int n){
+  char *keys = malloc((long) n * KEY_WIDTH);
+  for(int i = 0; i < n; i++){
+    snprintf(&keys[(long) i * KEY_WIDTH], KEY_WIDTH, "%s%d", prefix, i);
+  }
+  return keys;
+}
+
+int main(int argc, char *argv[]){
+  int nkeys = argc > 1 ? atoi(argv[1]) : 1000000;
+  int max_threads = argc > 2 ? atoi(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+  long lookups = argc > 3 ? atol(argv[3]) : 2000000;
+  if(nkeys < 2 || max_threads < 1 || lookups < 1){
+    printf("usage: %s [keys] [max_threads] [lookups_per_thread]\n", argv[0]);
+    return 1;
+  }
+  char *keys = make_keys("key", nkeys);
+  char *misses = make_keys("miss", nkeys);
+  worker_t *workers = calloc(max_threads, sizeof(worker_t));
+  pthread_t *threads = malloc(max_threads * sizeof(pthread_t));
+  atomic_int stop;
+
+  // ingest: half the keys, leaving the rest for the mixed phase
+  int base = nkeys / 2;
+  chashset_t chs;
+  chashset_init(&chs, 16, 0, NULL);
+  double start = now();
+  for(int t = 0; t < max_threads; t++){
+    workers[t] = (worker_t) {.chs = &chs, .keys = keys,
+                             .first = (long) base * t / max_threads,
+                             .last = (long) base * (t + 1) / max_threads};
+    pthread_create(&threads[t], NULL, ingest_thread, &workers[t]);
+  }
+  long errors = 0;
+  for(int t = 0; t < max_threads; t++){
+    pthread_join(threads[t], NULL);
+    errors += workers[t].errors;
+  }
+  double secs = now() - start;
+  errors += chashset_count(&chs) != base;
+  printf("%-8s %7s %12s %10s %8s\n", "phase", "threads", "ops", "Mops/s", "errors");
+  printf("%-8s %7d %12d %10.2f %8ld\n", "ingest", max_threads, base, base / secs / 1e6, errors);
+
+  // contains: scaling of read-only lookups with thread count
+  for(int nthreads = 1; ; nthreads *= 2){
+    if(nthreads > max_threads){
+      nthreads = max_threads;
+    }
+    start = now();
+    for(int t = 0; t < nthreads; t++){
+      workers[t] = (worker_t) {.chs = &chs, .keys = keys, .misses = misses, .nkeys = base,
+                               .lookups = lookups, .seed = 0x9E3779B97F4A7C15UL * (t + 1)};
+      pthread_create(&threads[t], NULL, contains_thread, &workers[t]);
+    }
+    long done = 0;
+    errors = 0;
+    for(int t = 0; t < nthreads; t++){
+      pthread_join(threads[t], NULL);
+      done += workers[t].done;
+      errors += workers[t].errors;
+    }
+    secs = now() - start;
+    printf("%-8s %7d %12ld %10.2f %8ld\n", "contains", nthreads, done, done / secs / 1e6, errors);
+    if(nthreads == max_threads){
+      break;
+    }
+  }
+
+  // mixed: readers of present keys while one writer grows the table
+  atomic_init(&stop, 0);
+  int nreaders = max_threads > 1 ? max_threads - 1 : 1;
+  start = now();
+  for(int t = 0; t < nreaders; t++){
+    workers[t] = (worker_t) {.chs = &chs, .keys = keys, .nkeys = base, .stop = &stop,
+                             .seed = 0xD1B54A32D192ED03UL * (t + 1)};
+    pthread_create(&threads[t], NULL, reader_thread, &workers[t]);
+  }
+  worker_t writer = {.chs = &chs, .keys = keys, .first = base, .last = nkeys};
+  ingest_thread(&writer);
+  atomic_store(&stop, 1);
+  long done = 0;
+  errors = writer.errors;
+  for(int t = 0; t < nreaders; t++){
+    pthread_join(threads[t], NULL);
+    done += workers[t].done;
+    errors += workers[t].errors;
+  }
+  secs = now() - start;
+  errors += chashset_count(&chs) != nkeys;
+  printf("%-8s %7d %12ld %10.2f %8ld\n", "mixed", nreaders, done, done / secs / 1e6, errors);
+  printf("table_size: %d  elem_count: %d\n", chashset_table_size(&chs), chashset_count(&chs));
+
+  chashset_free_fields(&chs);
+  free(threads);
+  free(workers);
+  free(misses);
+  free(keys);
+  return errors != 0;
+}
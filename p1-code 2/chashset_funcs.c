@@ -0,0 +1,201 @@
+#include "chashset.h"
+#include <string.h>
+#include <stdlib.h>
+#include <sched.h>
+// chashset_funcs.c: thread-safe hash set. Writers lock one of a fixed
+// set of stripes chosen by the key's hash; readers take no lock.
+//
+// A new node is fully written before a release store makes it the
+// head of its bucket, so a reader that walks a bucket sees either the
+// list before or after the add, never a half built node. Nodes are
+// never freed while the set is in use, so a pointer a reader holds
+// always stays valid.
+//
+// Growing the table moves nodes between lists, so a reader walking a
+// list during a resize can miss nodes. Resizes take every stripe and
+// bump the sequence counter 'seq' before and after; a reader that did
+// not find its key re-checks 'seq' and retries if a resize overlapped
+// its search (a seqlock). A key that was found is certainly present,
+// so hits never retry. Old bucket arrays may still be in use by
+// readers and are only freed with the set.
+
+void chashset_init(chashset_t *chs, int table_size, int stripes, hashfunc_t hashfunc){
+    if(stripes <= 0){
+        stripes = CHASHSET_DEFAULT_STRIPES;
+    }
+    int stripe_count = 1;
+    while(stripe_count < stripes){
+        stripe_count *= 2;
+    }
+    int size = stripe_count;
+    while(size < table_size){
+        size *= 2;
+    }
+    chashtable_t *table = calloc(1, sizeof(chashtable_t) + size * sizeof(chashnode_t *));
+    table->size = size;
+    table->retired = NULL;
+    atomic_init(&chs->table, table);
+    atomic_init(&chs->seq, 0);
+    atomic_init(&chs->elem_count, 0);
+    chs->stripe_count = stripe_count;
+    chs->stripes = malloc(stripe_count * sizeof(pthread_mutex_t));
+    for(int i = 0; i < stripe_count; i++){
+        pthread_mutex_init(&chs->stripes[i], NULL);
+    }
+    chs->hashfunc = hashfunc != NULL ? hashfunc : hashset_hash_parse("wyhash");
+    chs->max_load = CHASHSET_MAX_LOAD;
+}
+// Initialize 'chs' before any thread uses it. The number of stripes
+// is rounded up to a power of two (0 selects CHASHSET_DEFAULT_STRIPES)
+// and the table size to a power of two no smaller than the stripe
+// count. Since the table only ever doubles, a key's stripe, the low
+// bits of its hash, is then the same for every table size. A NULL
+// 'hashfunc' selects wyhash, whose low bits suit masked indexing.
+
+static chashnode_t *bucket_find(chashnode_t *node, char key[], int len, int hash){
+    while(node != NULL){
+        if(node->hash == hash && node->len == len && memcmp(node->key, key, len) == 0){
+            return node;
+        }
+        node = atomic_load_explicit(&node->next, memory_order_acquire);
+    }
+    return NULL;
+}
+// Searches the list starting at 'node' for 'key', comparing cached
+// hash codes and lengths before characters.
+
+int chashset_contains(chashset_t *chs, char key[]){
+    int len = strlen(key);
+    int hash = chs->hashfunc(key, len);
+    while(1){
+        unsigned int seq = atomic_load_explicit(&chs->seq, memory_order_acquire);
+        if(seq & 1){
+            sched_yield();
+            continue;
+        }
+        chashtable_t *table = atomic_load_explicit(&chs->table, memory_order_acquire);
+        chashnode_t *head = atomic_load_explicit(&table->buckets[hash & (table->size - 1)],
+                                                 memory_order_acquire);
+        if(bucket_find(head, key, len, hash) != NULL){
+            return 1;
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if(atomic_load_explicit(&chs->seq, memory_order_relaxed) == seq){
+            return 0;
+        }
+    }
+}
+// Returns 1 if 'key' is in the set and 0 otherwise. Takes no lock: a
+// miss is only reported if no resize started or finished while the
+// bucket was searched, otherwise the search is repeated.
+
+static void chashset_grow(chashset_t *chs, int old_size){
+    for(int i = 0; i < chs->stripe_count; i++){
+        pthread_mutex_lock(&chs->stripes[i]);
+    }
+    chashtable_t *old = atomic_load_explicit(&chs->table, memory_order_relaxed);
+    if(old->size == old_size){
+        int size = 2 * old_size;
+        chashtable_t *table = calloc(1, sizeof(chashtable_t) + size * sizeof(chashnode_t *));
+        table->size = size;
+        table->retired = old;
+        unsigned int seq = atomic_load_explicit(&chs->seq, memory_order_relaxed);
+        atomic_store_explicit(&chs->seq, seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        for(int b = 0; b < old_size; b++){
+            chashnode_t *node = atomic_load_explicit(&old->buckets[b], memory_order_relaxed);
+            while(node != NULL){
+                chashnode_t *next = atomic_load_explicit(&node->next, memory_order_relaxed);
+                chashnode_t *_Atomic *bucket = &table->buckets[node->hash & (size - 1)];
+                atomic_store_explicit(&node->next, atomic_load_explicit(bucket, memory_order_relaxed),
+                                      memory_order_relaxed);
+                atomic_store_explicit(bucket, node, memory_order_relaxed);
+                node = next;
+            }
+        }
+        atomic_store_explicit(&chs->table, table, memory_order_release);
+        atomic_store_explicit(&chs->seq, seq + 2, memory_order_release);
+    }
+    for(int i = chs->stripe_count - 1; i >= 0; i--){
+        pthread_mutex_unlock(&chs->stripes[i]);
+    }
+}
+// Doubles the table unless another thread already grew it past
+// 'old_size'. Holds every stripe, in order, so no add runs meanwhile,
+// and keeps 'seq' odd while nodes are relinked so that readers retry
+// rather than trust a miss. Nodes are relinked, not copied, using
+// their cached hash codes. The old bucket array is kept on the new
+// table's 'retired' list as readers may still be walking it.
+
+int chashset_add(chashset_t *chs, char elem[]){
+    int len = strlen(elem);
+    int hash = chs->hashfunc(elem, len);
+    pthread_mutex_t *stripe = &chs->stripes[hash & (chs->stripe_count - 1)];
+    pthread_mutex_lock(stripe);
+    chashtable_t *table = atomic_load_explicit(&chs->table, memory_order_relaxed);
+    chashnode_t *_Atomic *bucket = &table->buckets[hash & (table->size - 1)];
+    chashnode_t *head = atomic_load_explicit(bucket, memory_order_relaxed);
+    if(bucket_find(head, elem, len, hash) != NULL){
+        pthread_mutex_unlock(stripe);
+        return 0;
+    }
+    chashnode_t *node = malloc(sizeof(chashnode_t) + len + 1);
+    node->hash = hash;
+    node->len = len;
+    memcpy(node->key, elem, len + 1);
+    atomic_init(&node->next, head);
+    atomic_store_explicit(bucket, node, memory_order_release);
+    int count = atomic_fetch_add_explicit(&chs->elem_count, 1, memory_order_relaxed) + 1;
+    int size = table->size;
+    pthread_mutex_unlock(stripe);
+    if(count > chs->max_load * size){
+        chashset_grow(chs, size);
+    }
+    return 1;
+}
+// Adds 'elem' and returns 1, or returns 0 without changes if it is
+// already present. Unlike hashset_add() nothing is printed, as many
+// threads may be adding at once. Only the stripe owning the key's
+// bucket is locked, so adds of keys in different stripes proceed in
+// parallel. The table doubles once the load exceeds `max_load`; the
+// grow happens after the stripe is released since it needs all of
+// them.
+
+int chashset_count(chashset_t *chs){
+    return atomic_load_explicit(&chs->elem_count, memory_order_relaxed);
+}
+// Returns the number of elements in the set.
+
+int chashset_table_size(chashset_t *chs){
+    return atomic_load_explicit(&chs->table, memory_order_acquire)->size;
+}
+// Returns the number of buckets in the current table.
+
+void chashset_free_fields(chashset_t *chs){
+    chashtable_t *table = atomic_load_explicit(&chs->table, memory_order_relaxed);
+    for(int b = 0; b < table->size; b++){
+        chashnode_t *node = atomic_load_explicit(&table->buckets[b], memory_order_relaxed);
+        while(node != NULL){
+            chashnode_t *next = atomic_load_explicit(&node->next, memory_order_relaxed);
+            free(node);
+            node = next;
+        }
+    }
+    while(table != NULL){
+        chashtable_t *retired = table->retired;
+        free(table);
+        table = retired;
+    }
+    for(int i = 0; i < chs->stripe_count; i++){
+        pthread_mutex_destroy(&chs->stripes[i]);
+    }
+    free(chs->stripes);
+    atomic_store_explicit(&chs->table, NULL, memory_order_relaxed);
+    chs->stripes = NULL;
+    chs->stripe_count = 0;
+    atomic_store_explicit(&chs->elem_count, 0, memory_order_relaxed);
+}
+// De-allocates every node, the current and retired tables and the
+// stripe locks of 'chs'. Must only be called once no other thread is
+// using the set. As with hashset_free_fields(), 'chs' itself is not
+// free()'d.
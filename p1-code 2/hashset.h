@@ -7,11 +7,55 @@
 
 // Type for linked list nodes in hash set
 typedef struct hashnode {
-  char elem[64];                // string for the element in this node
+  unsigned int elem_off;        // offset of the element string in the hash set's key pool
+  int elem_len;                 // strlen() of the element
+  int hash;                     // cached hash code of the element
   struct hashnode *table_next;  // pointer to next node at table index of this node, NULL if last node
   struct hashnode *order_next;  // pointer to next node in insert order, NULL if last element added
+  struct hashnode *order_prev;  // pointer to previous node in insert order, NULL if first element added
 } hashnode_t;
 
+// Block of nodes carved out of one allocation; a hash set's blocks
+// form a list from the newest to the oldest
+typedef struct hashslab {
+  struct hashslab *next;        // next older slab, NULL for the first one allocated
+  int used;                     // nodes handed out from the front of 'nodes'
+  int cap;                      // length of 'nodes'
+  hashnode_t nodes[];           // node storage
+} hashslab_t;
+
+// Hash function that can be plugged into a hash set: takes a key and
+// its strlen() and returns a hash code of any sign
+typedef int (*hashfunc_t)(char key[], int len);
+
+typedef struct {
+  char *name;                   // name accepted by hashset_hash_parse()
+  hashfunc_t func;              // the function itself
+} hashset_hashdef_t;
+
+#define HASHSET_HASH_COUNT 3    // number of built-in hash functions
+
+// Storage engines a hash set can be initialized with
+typedef enum {
+  HASHSET_CHAINED = 0,          // table of buckets each holding a linked list of nodes
+  HASHSET_FLAT    = 1,          // open addressing: control bytes + slots indexing dense entries
+} hashset_engine_t;
+
+// How table sizes are chosen and hash codes reduced to table indices
+typedef enum {
+  HASHSET_SIZE_PRIME = 0,       // prime sizes, index is |hash| modulo table_size
+  HASHSET_SIZE_POW2  = 1,       // power of two sizes, index is the low bits of hash
+} hashset_sizing_t;
+
+// Type for elements of a flat hash set; kept in a dense array in insert order
+typedef struct {
+  int hash;                     // cached hash code of the key
+  int len;                      // strlen() of the key, HASHSET_ENTRY_DEAD once removed
+  unsigned int off;             // offset of the key string in the hash set's key pool
+} hashentry_t;
+
+#define HASHSET_ENTRY_DEAD -1   // 'len' of a flat entry whose key has been removed
+
 // Type of hash table
 typedef struct {
   int elem_count;               // number of elements in the table
@@ -19,18 +63,161 @@ typedef struct {
   hashnode_t **table;           // array of "buckets" which contain nodes
   hashnode_t *order_first;      // pointer to the first element node that was added
   hashnode_t *order_last;       // pointer to last element that node that was added
+  hashset_engine_t engine;      // which storage engine the fields below/above belong to
+  unsigned char *ctrl;          // FLAT: per-slot control byte, HASHSET_CTRL_EMPTY or 7 bits of hash
+  int *slots;                   // FLAT: per-slot index into 'entries'
+  hashentry_t *entries;         // FLAT: elements in the order they were added
+  int entry_len;                // FLAT: used length of 'entries' including removed elements
+  int entry_cap;                // FLAT: allocated length of 'entries'
+  int incremental;              // CHAINED: 1 to spread expansion over later operations
+  hashnode_t **old_table;       // CHAINED: table being migrated from, NULL if no rehash pending
+  int old_size;                 // CHAINED: size of 'old_table'
+  int rehash_pos;               // CHAINED: buckets of 'old_table' below this have been migrated
+  unsigned long mod_magic;      // hashset_mod_magic(table_size) for division-free modulo
+  unsigned long old_magic;      // CHAINED: hashset_mod_magic(old_size)
+  double max_load;              // add expands when the load would exceed this, 0 to never expand
+  double growth_factor;         // expand grows table_size by at least this factor
+  hashset_sizing_t sizing;      // prime or power of two table sizes
+  hashfunc_t hashfunc;          // hash function used for every key, hashcode() by default
+  hashslab_t *slabs;            // CHAINED: slabs that all nodes are allocated from, newest first
+  hashnode_t *free_nodes;       // CHAINED: nodes of removed elements linked by 'table_next'
+  char *pool;                   // every key added, '\0' terminated and back to back
+  unsigned long pool_len;       // bytes of 'pool' in use
+  unsigned long pool_cap;       // allocated length of 'pool'
+  unsigned long pool_dead;      // bytes of 'pool' holding removed keys
+  void *map;                    // FLAT: read-only snapshot the arrays above point into, NULL if none
+  unsigned long map_len;        // FLAT: length of 'map'
+  unsigned long *bloom;         // blocked Bloom filter consulted before lookups, NULL if none
+  int bloom_blocks;             // 64-byte blocks in 'bloom'
+  int bloom_cap;                // elems 'bloom' was sized for; rebuilt larger past this
+  unsigned long bloom_checks;   // lookups that consulted the filter
+  unsigned long bloom_rejects;  // of those, lookups the filter answered alone
+  unsigned long bloom_false;    // of those, lookups the filter passed that found nothing
 } hashset_t;
 
+// Orders a cursor can visit the elems of a hash set in
+typedef enum {
+  HASHSET_ITER_ORDER  = 0,      // insertion order, as printed by hashset_write_elems_ordered()
+  HASHSET_ITER_BUCKET = 1,      // table order: bucket by bucket, or slot by slot for flat sets
+} hashset_iter_kind_t;
+
+// Cursor over the elems of a hash set, set up by hashset_iter_init();
+// lives wherever the caller puts it and owns no memory
+typedef struct {
+  hashset_t *hs;                // set being iterated
+  hashset_iter_kind_t kind;     // order elems are visited in
+  hashnode_t *node;             // CHAINED: next node to return, NULL to move to the next bucket
+  int pos;                      // FLAT: next entry (ORDER) or slot (BUCKET); CHAINED BUCKET: next bucket
+  int old;                      // CHAINED BUCKET: 1 once walking the old table of a pending rehash
+  int len;                      // strlen() of the elem last returned
+  int hash;                     // cached hash code of the elem last returned
+} hashset_iter_t;
+
+// The key string stored at offset 'off' of the key pool of 'hs'
+#define HASHSET_KEY(hs, off) ((hs)->pool + (off))
+
 #define HASHSET_DEFAULT_TABLE_SIZE 5 // default size of table for main application
+#define HASHSET_CTRL_EMPTY  0x80     // control byte of an unused flat slot
+#define HASHSET_FLAT_LOAD_NUM 7      // flat tables expand before load exceeds 7/8
+#define HASHSET_FLAT_LOAD_DEN 8
+#define HASHSET_DEFAULT_GROWTH 2.0   // growth factor giving the classic next_prime(2*size+1)
+#define HASHSET_SLAB_MIN 16          // nodes in the first slab of a hash set
+#define HASHSET_SLAB_MAX 65536       // slabs double in size up to this many nodes
+#define HASHSET_SIEVE_LIMIT 65536    // sieve covers every prime factor an int can have
+#define HASHSET_REHASH_STEP 4        // old buckets migrated per add/contains during incremental rehash
+#define HASHSET_POOL_MIN 256         // bytes in the first key pool of a hash set
+#define HASHSET_KEY_MAX 4096         // starting size of the command buffer in hashset_main.c, grown as needed
+#define HASHSET_BATCH 16             // keys hashed and prefetched together by the _many functions
+#define HASHSET_PLOAD_PER_CPU 4      // most threads pload and the set operations start per CPU
+
+#define HASHSET_BLOOM_BITS 10        // filter bits per elem, about a 1% false positive rate
+#define HASHSET_BLOOM_K 6            // bits set per elem, all in one 64-byte block
+#define HASHSET_BLOOM_WORDS 8        // unsigned longs per block
+#define HASHSET_BLOOM_MIN 64         // smallest number of elems a filter is sized for
+#define HASHSET_STATS_BINS 8         // chain histogram bins; the last counts that length or more
+
+// Summary of the layout of a hash set, filled in by hashset_stats()
+typedef struct {
+  int elem_count;               // number of elements
+  int buckets;                  // buckets or slots examined, counting old buckets still to be rehashed
+  int chain_hist[HASHSET_STATS_BINS]; // [0] empty buckets; [i] CHAINED: buckets of i elems, FLAT: elems i probes from home
+  int max_chain;                // longest chain, or longest probe of a flat set
+  double empty_fraction;        // chain_hist[0] / buckets
+  double avg_probe;             // mean number of keys compared to find an element present
+  unsigned long heap_bytes;     // bytes allocated for the table, nodes/entries and key pool
+  unsigned long mapped_bytes;   // bytes of a snapshot mapping the set reads from, 0 if none
+  unsigned long pool_dead;      // bytes of the key pool still holding removed keys
+  unsigned long bloom_bytes;    // size of the Bloom filter, 0 if the set has none
+  unsigned long bloom_checks;   // lookups that consulted the filter since it was attached
+  double bloom_hit_ratio;       // fraction of those the filter answered without a search
+  double bloom_fpr;             // fraction of absent keys the filter passed anyway
+} hashset_stats_t;
+
+#ifdef __GNUC__
+#define HASHSET_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define HASHSET_PREFETCH(addr) ((void) (addr))
+#endif
+
+#define HASHSET_SNAP_MAGIC "HASHSNAP"    // first 8 bytes of a snapshot file
+#define HASHSET_SNAP_VERSION 1           // bumped whenever the layout below changes
+#define HASHSET_SNAP_BYTE_ORDER 0x01020304 // reads back differently on a machine of the other byte order
+
+// Header at the start of a binary snapshot written by
+// hashset_save_snapshot(). The arrays of a flat hash set follow at
+// the given offsets, each 8-byte aligned, so the file can be mapped
+// and used in place.
+typedef struct {
+  char magic[8];                // HASHSET_SNAP_MAGIC without its '\0'
+  unsigned int version;         // HASHSET_SNAP_VERSION
+  unsigned int byte_order;      // HASHSET_SNAP_BYTE_ORDER
+  int table_size;               // slots in the 'ctrl' and 'slots' arrays
+  int elem_count;               // entries in the 'entries' array
+  int hashfunc;                 // index of the hash function in hashset_hashfuncs[]
+  int sizing;                   // hashset_sizing_t of the set
+  double max_load;              // growth policy of the set
+  double growth_factor;
+  unsigned long ctrl_off;       // file offset of 'ctrl', table_size bytes
+  unsigned long slots_off;      // file offset of 'slots', table_size ints
+  unsigned long entries_off;    // file offset of 'entries', elem_count hashentry_t's
+  unsigned long pool_off;       // file offset of the key pool
+  unsigned long pool_len;       // bytes in the key pool
+  unsigned long file_len;       // total length of the file
+} hashset_snaphdr_t;
 
 // functions defined in hashset_funcs.c
 int   hashcode(char key[]);
 int   next_prime(int num);
+unsigned long hashset_mod_magic(int size);
 
 void  hashset_init(hashset_t *hs, int table_size);
+void  hashset_init_engine(hashset_t *hs, int table_size, hashset_engine_t engine);
+int   hashset_engine_parse(char *name);
+int   hashset_bucket(hashset_t *hs, int hash);
+int   hashset_hash(hashset_t *hs, char key[]);
+unsigned int hashset_pool_add(hashset_t *hs, char key[], int len);
+void  hashset_set_hash(hashset_t *hs, hashfunc_t func);
+void  hashset_show_hashdist(hashset_t *hs);
+void  hashset_stats(hashset_t *hs, hashset_stats_t *stats);
+void  hashset_stats_bin(hashset_stats_t *stats, int len);
+void  hashset_show_stats(hashset_t *hs);
+char *hashset_engine_name(hashset_engine_t engine);
 int   hashset_add(hashset_t *hs, char elem[]);
 int   hashset_contains(hashset_t *hs, char key[]);
+int   hashset_remove(hashset_t *hs, char elem[]);
+int   hashset_add_many(hashset_t *hs, char *keys[], int n);
+int   hashset_contains_many(hashset_t *hs, char *keys[], int n, int found[]);
+int   hashset_batch_file(hashset_t *hs, char *filename, int add);
 void  hashset_expand(hashset_t *hs);
+void  hashset_reset(hashset_t *hs, int table_size);
+void  hashset_set_incremental(hashset_t *hs, int on);
+int   hashset_set_growth(hashset_t *hs, double max_load, double growth_factor, hashset_sizing_t sizing);
+int   hashset_sizing_parse(char *name);
+char *hashset_sizing_name(hashset_sizing_t sizing);
+int   hashset_next_size(hashset_t *hs);
+void  hashset_resize(hashset_t *hs, int size);
+void  hashset_rehash_step(hashset_t *hs, int buckets);
+void  hashset_rehash_finish(hashset_t *hs);
 void  hashset_free_fields(hashset_t *hs);
 
 void  hashset_write_elems_ordered(hashset_t *hs, FILE *out);
@@ -38,4 +225,50 @@ void  hashset_show_structure(hashset_t *hs);
 void  hashset_save(hashset_t *hs, char *filename);
 int   hashset_load(hashset_t *hs, char *filename);
 
+// functions defined in hashset_hash.c
+extern hashset_hashdef_t hashset_hashfuncs[HASHSET_HASH_COUNT];
+hashfunc_t hashset_hash_parse(char *name);
+char *hashset_hash_name(hashfunc_t func);
+
+// functions defined in hashset_flat.c
+void  hashset_flat_init(hashset_t *hs, int table_size);
+int   hashset_flat_add(hashset_t *hs, char elem[]);
+int   hashset_flat_contains(hashset_t *hs, char key[]);
+int   hashset_flat_remove(hashset_t *hs, char elem[]);
+void  hashset_flat_compact(hashset_t *hs);
+int   hashset_flat_add_many(hashset_t *hs, char *keys[], int n);
+int   hashset_flat_contains_many(hashset_t *hs, char *keys[], int n, int found[]);
+void  hashset_flat_resize(hashset_t *hs, int size);
+void  hashset_flat_rehash(hashset_t *hs);
+void  hashset_flat_free_fields(hashset_t *hs);
+void  hashset_flat_show_structure(hashset_t *hs);
+void  hashset_flat_stats(hashset_t *hs, hashset_stats_t *stats);
+int   hashset_flat_claim(hashset_t *hs, int e, int limit);
+
+// functions defined in hashset_iter.c
+void  hashset_iter_init(hashset_iter_t *it, hashset_t *hs, hashset_iter_kind_t kind);
+char *hashset_iter_next(hashset_iter_t *it);
+int   hashset_iter_next_many(hashset_iter_t *it, char *keys[], int lens[], int n);
+
+// functions defined in hashset_bloom.c
+void  hashset_set_bloom(hashset_t *hs, int on);
+void  hashset_bloom_build(hashset_t *hs);
+void  hashset_bloom_add(hashset_t *hs, int hash);
+int   hashset_bloom_maybe(hashset_t *hs, int hash);
+int   hashset_bloom_result(hashset_t *hs, int hit);
+
+// functions defined in hashset_pload.c
+int   hashset_load_parallel(hashset_t *hs, char *files[], int nfiles, int nthreads);
+
+// functions defined in hashset_setops.c
+int   hashset_union(hashset_t *dst, hashset_t *a, hashset_t *b, int nthreads);
+int   hashset_intersect(hashset_t *dst, hashset_t *a, hashset_t *b, int nthreads);
+int   hashset_difference(hashset_t *dst, hashset_t *a, hashset_t *b, int nthreads);
+
+// functions defined in hashset_snap.c
+int   hashset_save_snapshot(hashset_t *hs, char *filename);
+int   hashset_load_snapshot(hashset_t *hs, char *filename);
+void  hashset_snapshot_detach(hashset_t *hs);
+void  hashset_snapshot_unmap(hashset_t *hs);
+
 #endif
@@ -0,0 +1,245 @@
+// hashset_bench.c: micro-benchmark for hash sets. For every
+// combination of engine, hash function, key distribution and size it
+// measures
+//
+// insert : adding 'size' distinct keys to a set that starts at the
+//          default table size and expands above a load of BENCH_MAX_LOAD
+// hit    : looking up keys that are present
+// miss   : looking up keys that are absent
+// expand : one explicit hashset_expand() of the full set
+//
+// and writes one CSV line per measurement to stdout:
+//
+//   engine,hash,keys,size,op,ops,ns_per_op,p50_ns,p99_ns,p999_ns,max_chain
+//
+// ns_per_op is the total time over 'ops' operations; for expand, 'ops'
+// is the number of elements moved and the percentiles are all the
+// time of the one call. Percentiles come from timing a sample of up to
+// BENCH_SAMPLES individual operations, so include the cost of reading
+// the clock. max_chain is the longest bucket list of a chained set or
+// the longest probe of a flat one, after the inserts and, for expand,
+// after the expansion. Lookups are capped at -lookups per measurement.
+// With -bloom 1 every set gets a Bloom filter and its engine column
+// reads e.g. "flat+bloom".
+//
+// usage: ./hashset_bench [-min N] [-max N] [-lookups N]
+//                        [-engine chained|flat|all] [-hash java|wyhash|crc32c|all]
+//                        [-keys seq|short|medium|long|all] [-bloom 0|1]
+//
+// Sizes run through the powers of ten from -min (default 1e3) to -max
+// (default 1e6); -max 1e8 works but needs several GB for the keys.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hashset.h"
+
+#define BENCH_SAMPLES (1 << 20)         // most operations individually timed per measurement
+#define BENCH_KEYS 4                    // number of key distributions
+#define BENCH_MAX_LOAD 1.0              // growth policy max load during the inserts
+
+// Distribution of generated keys
+typedef struct {
+  char *name;                           // name accepted by -keys
+  int min_len;                          // shortest key, including the unique suffix
+  int max_len;                          // longest key
+} keydist_t;
+
+static keydist_t keydists[BENCH_KEYS] = {
+  {"seq",     0,   0},                  // "key<i>", sequential and similar
+  {"short",   8,  16},
+  {"medium", 24,  40},
+  {"long",   64, 256},
+};
+
+static double now_ns(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long next_rand(unsigned long *state){
+  unsigned long x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x;
+}
+
+// Fills 'keys' with 'n' distinct keys of the given distribution,
+// stored back to back in one returned block. Every key ends with
+// 'sep' and its index in base 36, so keys made with different
+// separators never collide.
+static char *make_keys(keydist_t *dist, int n, char sep, unsigned long seed, char **keys){
+  long cap = (long) n * (dist->max_len + 16);
+  char *block = malloc(cap);
+  if(block == NULL){
+    printf("could not allocate %ld bytes of keys\n", cap);
+    exit(1);
+  }
+  long pos = 0;
+  for(int i = 0; i < n; i++){
+    keys[i] = &block[pos];
+    if(dist->max_len == 0){
+      pos += sprintf(&block[pos], "key%c%d", sep, i) + 1;
+      continue;
+    }
+    char suffix[16];
+    int slen = 0;
+    suffix[slen++] = sep;
+    int v = i;
+    do{
+      suffix[slen++] = "0123456789abcdefghijklmnopqrstuvwxyz"[v % 36];
+      v /= 36;
+    } while(v > 0);
+    int len = dist->min_len + next_rand(&seed) % (dist->max_len - dist->min_len + 1);
+    for(int c = 0; c < len - slen; c++){
+      block[pos++] = 'a' + next_rand(&seed) % 26;
+    }
+    memcpy(&block[pos], suffix, slen);
+    pos += slen;
+    block[pos++] = '\0';
+  }
+  return block;
+}
+
+static int cmp_double(const void *a, const void *b){
+  double x = *(double *) a, y = *(double *) b;
+  return x < y ? -1 : x > y;
+}
+
+static int max_chain(hashset_t *hs){
+  hashset_stats_t stats;
+  hashset_stats(hs, &stats);
+  return stats.max_chain;
+}
+
+// Runs 'op' on keys[0..n-1], returning the total time in ns. Every
+// stride'th call is also timed on its own into 'samples', sorted on
+// return, with their number stored in '*nsamples'.
+static double measure(hashset_t *hs, char **keys, int n, int (*op)(hashset_t *, char *),
+                      double *samples, int *nsamples){
+  int stride = n / BENCH_SAMPLES + 1;
+  int count = 0;
+  double start = now_ns();
+  for(int i = 0; i < n; i++){
+    if(i % stride == 0){
+      double t = now_ns();
+      op(hs, keys[i]);
+      samples[count++] = now_ns() - t;
+    } else{
+      op(hs, keys[i]);
+    }
+  }
+  double total = now_ns() - start;
+  qsort(samples, count, sizeof(double), cmp_double);
+  *nsamples = count;
+  return total;
+}
+
+// Prints one CSV line after 'prefix', the engine/hash/keys/size
+// columns. 'samples' must be sorted.
+static void report(char *prefix, char *op, long ops, double total, double *samples, int nsamples,
+                   int chain){
+  printf("%s,%s,%ld,%.1f,%.0f,%.0f,%.0f,%d\n", prefix, op, ops, total / ops,
+         samples[nsamples / 2], samples[(long) nsamples * 99 / 100],
+         samples[(long) nsamples * 999 / 1000], chain);
+}
+
+static int op_add(hashset_t *hs, char *key){
+  return hashset_add(hs, key);
+}
+
+static int op_contains(hashset_t *hs, char *key){
+  return hashset_contains(hs, key);
+}
+
+static int selected(char *want, char *name){
+  return strcmp(want, "all") == 0 || strcmp(want, name) == 0;
+}
+
+int main(int argc, char *argv[]){
+  long min = 1000, max = 1000000, lookups = 1000000;
+  int bloom = 0;
+  char *engine_want = "all", *hash_want = "all", *keys_want = "all";
+  for(int a = 1; a + 1 < argc; a += 2){
+    if(strcmp(argv[a], "-min") == 0){
+      min = atof(argv[a + 1]);
+    } else if(strcmp(argv[a], "-max") == 0){
+      max = atof(argv[a + 1]);
+    } else if(strcmp(argv[a], "-lookups") == 0){
+      lookups = atof(argv[a + 1]);
+    } else if(strcmp(argv[a], "-engine") == 0){
+      engine_want = argv[a + 1];
+    } else if(strcmp(argv[a], "-hash") == 0){
+      hash_want = argv[a + 1];
+    } else if(strcmp(argv[a], "-keys") == 0){
+      keys_want = argv[a + 1];
+    } else if(strcmp(argv[a], "-bloom") == 0){
+      bloom = atoi(argv[a + 1]);
+    } else{
+      printf("unknown option %s\n", argv[a]);
+      return 1;
+    }
+  }
+  if(min < 1 || max < min || max > 1000000000 || lookups < 1){
+    printf("usage: %s [-min N] [-max N] [-lookups N] [-engine E] [-hash H] [-keys K] [-bloom 0|1]\n", argv[0]);
+    return 1;
+  }
+
+  char **keys = malloc(max * sizeof(char *));
+  char **misses = malloc(max * sizeof(char *));
+  double *samples = malloc(BENCH_SAMPLES * sizeof(double));
+  printf("engine,hash,keys,size,op,ops,ns_per_op,p50_ns,p99_ns,p999_ns,max_chain\n");
+  for(int k = 0; k < BENCH_KEYS; k++){
+    if(!selected(keys_want, keydists[k].name)){
+      continue;
+    }
+    char *key_block = make_keys(&keydists[k], max, '-', 0x9E3779B97F4A7C15UL, keys);
+    char *miss_block = make_keys(&keydists[k], max, '~', 0xD1B54A32D192ED03UL, misses);
+    for(long size = min; size <= max; size *= 10){
+      int nlookups = lookups < size ? lookups : size;
+      for(int e = HASHSET_CHAINED; e <= HASHSET_FLAT; e++){
+        if(!selected(engine_want, hashset_engine_name(e))){
+          continue;
+        }
+        for(int h = 0; h < HASHSET_HASH_COUNT; h++){
+          if(!selected(hash_want, hashset_hashfuncs[h].name)){
+            continue;
+          }
+          hashset_t hs;
+          hashset_init_engine(&hs, HASHSET_DEFAULT_TABLE_SIZE, e);
+          hashset_set_hash(&hs, hashset_hashfuncs[h].func);
+          hashset_set_growth(&hs, BENCH_MAX_LOAD, HASHSET_DEFAULT_GROWTH, HASHSET_SIZE_PRIME);
+          hashset_set_bloom(&hs, bloom);
+          char prefix[128];
+          snprintf(prefix, sizeof(prefix), "%s%s,%s,%s,%ld", hashset_engine_name(e), bloom ? "+bloom" : "",
+                   hashset_hashfuncs[h].name, keydists[k].name, size);
+
+          int nsamples;
+          double total = measure(&hs, keys, size, op_add, samples, &nsamples);
+          int chain = max_chain(&hs);
+          report(prefix, "insert", size, total, samples, nsamples, chain);
+          total = measure(&hs, keys, nlookups, op_contains, samples, &nsamples);
+          report(prefix, "hit", nlookups, total, samples, nsamples, chain);
+          total = measure(&hs, misses, nlookups, op_contains, samples, &nsamples);
+          report(prefix, "miss", nlookups, total, samples, nsamples, chain);
+          double start = now_ns();
+          hashset_expand(&hs);
+          hashset_rehash_finish(&hs);
+          samples[0] = now_ns() - start;
+          report(prefix, "expand", size, samples[0], samples, 1, max_chain(&hs));
+          hashset_free_fields(&hs);
+        }
+      }
+    }
+    free(key_block);
+    free(miss_block);
+  }
+  free(samples);
+  free(misses);
+  free(keys);
+  return 0;
+}
@@ -0,0 +1,135 @@
+#include "hashset.h"
+#include <string.h>
+#include <stdlib.h>
+// hashset_bloom.c: optional Bloom filter in front of a hash set's
+// lookups. The filter is blocked: it is an array of 64-byte blocks
+// and all HASHSET_BLOOM_K bits of a key lie in the one block its hash
+// code selects, so a lookup touches a single cache line and a key that
+// was never added is usually rejected there without reading the table
+// or comparing any key. Bits are derived from the cached hash code of
+// each elem, so building the filter never re-hashes a key.
+//
+// A Bloom filter cannot forget a key: hashset_remove() leaves the
+// bits of removed elems set, which only raises the false positive
+// rate until the filter is next rebuilt by an expansion.
+
+static unsigned long bloom_mix(int hash){
+    unsigned long x = (unsigned int) hash * 0x9E3779B97F4A7C15UL;
+    x ^= x >> 31;
+    x *= 0xC2B2AE3D27D4EB4FUL;
+    x ^= x >> 29;
+    return x;
+}
+// Spreads the 32 bits of a hash code over 64 well mixed bits so that
+// block choice and bit positions do not depend on each other, even for
+// hash functions like hashcode() whose low bits are weak.
+
+static unsigned long *bloom_block(hashset_t *hs, unsigned long x){
+    unsigned long index = (((x * 0xD6E8FEB86659FD93UL) >> 32) * (unsigned long) hs->bloom_blocks) >> 32;
+    return &hs->bloom[index * HASHSET_BLOOM_WORDS];
+}
+// Block of the filter a key with mixed hash 'x' maps to. The low bits
+// of 'x' pick the bits within the block, so the block comes from the
+// top bits of a further multiply, scaled to the block count by a
+// multiply-shift rather than a division.
+
+static void bloom_set(hashset_t *hs, int hash){
+    unsigned long x = bloom_mix(hash);
+    unsigned long *block = bloom_block(hs, x);
+    for(int i = 0; i < HASHSET_BLOOM_K; i++){
+        int bit = (x >> (9 * i)) & 511;
+        block[bit >> 6] |= 1UL << (bit & 63);
+    }
+}
+// Sets the HASHSET_BLOOM_K bits of a key: 9 bits of the mixed hash
+// pick each of them among the 512 bits of its block.
+
+void hashset_bloom_build(hashset_t *hs){
+    free(hs->bloom);
+    int cap = 2 * hs->elem_count;
+    if(cap < hs->table_size){
+        cap = hs->table_size;
+    }
+    if(cap < HASHSET_BLOOM_MIN){
+        cap = HASHSET_BLOOM_MIN;
+    }
+    long bits = (long) cap * HASHSET_BLOOM_BITS;
+    hs->bloom_blocks = (bits + 511) / 512;
+    hs->bloom_cap = cap;
+    hs->bloom = aligned_alloc(64, hs->bloom_blocks * 64);
+    memset(hs->bloom, 0, hs->bloom_blocks * 64);
+    if(hs->engine == HASHSET_FLAT){
+        for(int i = 0; i < hs->entry_len; i++){
+            if(hs->entries[i].len != HASHSET_ENTRY_DEAD){
+                bloom_set(hs, hs->entries[i].hash);
+            }
+        }
+    } else{
+        for(hashnode_t *node = hs->order_first; node != NULL; node = node->order_next){
+            bloom_set(hs, node->hash);
+        }
+    }
+}
+// (Re)builds the filter of 'hs' from the cached hash codes of its
+// elems, dropping the bits of any removed ones. The filter is sized for
+// 'bloom_cap' elems at HASHSET_BLOOM_BITS bits each, where 'bloom_cap'
+// is twice the current count but at least the table size, so it can
+// take many adds before it fills. Blocks are cache line aligned.
+
+void hashset_bloom_add(hashset_t *hs, int hash){
+    if(hs->elem_count > hs->bloom_cap){
+        hashset_bloom_build(hs);
+        return;
+    }
+    bloom_set(hs, hash);
+}
+// Records a newly added elem with the given hash code. Once the set
+// holds more elems than the filter was sized for, the filter is
+// rebuilt twice as large instead. Called only when 'hs' has a filter.
+
+int hashset_bloom_maybe(hashset_t *hs, int hash){
+    if(hs->bloom == NULL){
+        return 1;
+    }
+    hs->bloom_checks++;
+    unsigned long x = bloom_mix(hash);
+    unsigned long *block = bloom_block(hs, x);
+    for(int i = 0; i < HASHSET_BLOOM_K; i++){
+        int bit = (x >> (9 * i)) & 511;
+        if(!(block[bit >> 6] & (1UL << (bit & 63)))){
+            hs->bloom_rejects++;
+            return 0;
+        }
+    }
+    return 1;
+}
+// Returns 0 if a key with the given hash code is certainly not in the
+// set and 1 if it may be, in which case the table must be searched.
+// Always returns 1 if the set has no filter.
+
+int hashset_bloom_result(hashset_t *hs, int hit){
+    if(!hit && hs->bloom != NULL){
+        hs->bloom_false++;
+    }
+    return hit;
+}
+// Passes through the outcome of a table search made after
+// hashset_bloom_maybe() returned 1, counting searches that found
+// nothing as false positives of the filter.
+
+void hashset_set_bloom(hashset_t *hs, int on){
+    free(hs->bloom);
+    hs->bloom = NULL;
+    hs->bloom_blocks = 0;
+    hs->bloom_cap = 0;
+    hs->bloom_checks = 0;
+    hs->bloom_rejects = 0;
+    hs->bloom_false = 0;
+    if(on){
+        hashset_bloom_build(hs);
+    }
+}
+// Attaches a filter built from the current elems to 'hs' (on=1) or
+// removes it (on=0). Either way the lookup counters start from zero.
+// Lookups through hashset_contains() and hashset_contains_many() then
+// consult the filter first; adds and expansions keep it up to date.
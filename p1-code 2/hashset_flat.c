@@ -0,0 +1,414 @@
+#include "hashset.h"
+#include <string.h>
+#include <stdlib.h>
+// hashset_flat.c: open addressing engine for hash sets. Selected with
+// hashset_init_engine(hs, size, HASHSET_FLAT); the generic functions
+// in hashset_funcs.c dispatch here. Elements live in a dense array
+// 'entries' in the order they were added. The table itself is two
+// parallel arrays of 'table_size' slots: 'ctrl' holds one byte per
+// slot (HASHSET_CTRL_EMPTY or the top 7 bits of the hash code) and
+// 'slots' holds the index of the entry occupying that slot. Lookups
+// probe linearly from the home index computed by hashset_bucket()
+// and only touch an entry when its control byte matches, so most
+// probes stay inside the small, contiguous 'ctrl' array.
+
+static unsigned char flat_h2(int hash){
+    return ((unsigned int) hash >> 25) & 0x7F;
+}
+// Control byte stored for a key with the given hash code: the top 7
+// bits, which are independent of the low bits used to pick the slot.
+
+static int flat_find_slot(hashset_t *hs, char key[], int len, int hash){
+    unsigned char h2 = flat_h2(hash);
+    int i = hashset_bucket(hs, hash);
+    while(hs->ctrl[i] != HASHSET_CTRL_EMPTY){
+        if(hs->ctrl[i] == h2){
+            hashentry_t *entry = &hs->entries[hs->slots[i]];
+            if(entry->hash == hash && entry->len == len &&
+               memcmp(HASHSET_KEY(hs, entry->off), key, len) == 0){
+                return i;
+            }
+        }
+        i++;
+        if(i == hs->table_size){
+            i = 0;
+        }
+    }
+    return -1 - i;
+}
+// Probes for 'key' starting at its home slot. Returns the slot index
+// if found. Otherwise returns -1-i where i is the empty slot that
+// ended the probe, which is where the key would be placed. The table
+// is never allowed to fill so every probe reaches an empty slot. An
+// entry's cached hash and length are compared before its key in the
+// pool is read.
+
+static void flat_place(hashset_t *hs, int entry_index){
+    int hash = hs->entries[entry_index].hash;
+    int i = hashset_bucket(hs, hash);
+    while(hs->ctrl[i] != HASHSET_CTRL_EMPTY){
+        i++;
+        if(i == hs->table_size){
+            i = 0;
+        }
+    }
+    hs->ctrl[i] = flat_h2(hash);
+    hs->slots[i] = entry_index;
+}
+// Places an entry already known to be absent into the first empty
+// slot on its probe sequence. Used when rebuilding the table.
+
+void hashset_flat_init(hashset_t *hs, int table_size){
+    hs->ctrl = malloc(table_size * sizeof(unsigned char));
+    memset(hs->ctrl, HASHSET_CTRL_EMPTY, table_size);
+    hs->slots = malloc(table_size * sizeof(int));
+    hs->entry_len = 0;
+    hs->entry_cap = 0;
+    hs->entries = NULL;
+}
+// Allocates the control and slot arrays for a flat table of the
+// given size with every slot empty. The entries array is allocated
+// on the first add. Called from hashset_init_engine() which has
+// already set the common fields.
+
+int hashset_flat_contains(hashset_t *hs, char key[]){
+    int len = strlen(key);
+    int hash = hs->hashfunc(key, len);
+    if(!hashset_bloom_maybe(hs, hash)){
+        return 0;
+    }
+    return hashset_bloom_result(hs, flat_find_slot(hs, key, len, hash) >= 0);
+}
+// Returns 1 if 'key' is in the flat hash set and 0 otherwise,
+// searching the table only if a Bloom filter does not rule it out.
+
+static int flat_insert(hashset_t *hs, char elem[], int len, int hash){
+    int slot = flat_find_slot(hs, elem, len, hash);
+    if(slot >= 0){
+        return 0;
+    }
+    hashset_snapshot_detach(hs);
+    if((hs->elem_count + 1) * HASHSET_FLAT_LOAD_DEN > hs->table_size * HASHSET_FLAT_LOAD_NUM ||
+       (hs->max_load > 0 && hs->elem_count + 1 > hs->max_load * hs->table_size)){
+        hashset_expand(hs);
+        slot = flat_find_slot(hs, elem, len, hash);
+    }
+    if(hs->entry_len == hs->entry_cap){
+        hs->entry_cap = hs->entry_cap == 0 ? 8 : 2 * hs->entry_cap;
+        hs->entries = realloc(hs->entries, hs->entry_cap * sizeof(hashentry_t));
+    }
+    hashentry_t *entry = &hs->entries[hs->entry_len];
+    entry->hash = hash;
+    entry->len = len;
+    entry->off = hashset_pool_add(hs, elem, len);
+    slot = -1 - slot;
+    hs->ctrl[slot] = flat_h2(hash);
+    hs->slots[slot] = hs->entry_len;
+    hs->entry_len++;
+    hs->elem_count++;
+    if(hs->bloom != NULL){
+        hashset_bloom_add(hs, hash);
+    }
+    return 1;
+}
+// Adds 'elem', whose length and hash code the caller has computed,
+// unless it is already present; returns 1 if it was added and 0
+// otherwise without printing anything.
+
+int hashset_flat_add(hashset_t *hs, char elem[]){
+    int len = strlen(elem);
+    if(!flat_insert(hs, elem, len, hs->hashfunc(elem, len))){
+        printf("Elem already present, no changes made\n");
+        return 0;
+    }
+    return 1;
+}
+// Same contract as hashset_add(). Copies the element to the key pool,
+// appends its 12 byte entry to 'entries' and claims the empty slot
+// that ended its probe. Open addressing cannot exceed a load of 1 so
+// the table always expands itself before the load would pass 7/8, or
+// the policy's `max_load` if that is lower. A set still mapped from a
+// snapshot is first copied to the heap.
+
+static void flat_batch_prepare(hashset_t *hs, char *keys[], int n, int lens[], int hashes[]){
+    for(int i = 0; i < n; i++){
+        lens[i] = strlen(keys[i]);
+        hashes[i] = hs->hashfunc(keys[i], lens[i]);
+        int home = hashset_bucket(hs, hashes[i]);
+        HASHSET_PREFETCH(&hs->ctrl[home]);
+        HASHSET_PREFETCH(&hs->slots[home]);
+    }
+    for(int i = 0; i < n; i++){
+        int home = hashset_bucket(hs, hashes[i]);
+        if(hs->ctrl[home] == flat_h2(hashes[i])){
+            HASHSET_PREFETCH(&hs->entries[hs->slots[home]]);
+        }
+    }
+}
+// First two stages of a flat batch: hashes every key and prefetches
+// the control byte and slot of its home index, then prefetches the
+// entry of every key whose home control byte matches.
+
+int hashset_flat_contains_many(hashset_t *hs, char *keys[], int n, int found[]){
+    int lens[HASHSET_BATCH], hashes[HASHSET_BATCH];
+    int count = 0;
+    for(int start = 0; start < n; start += HASHSET_BATCH){
+        int batch = n - start < HASHSET_BATCH ? n - start : HASHSET_BATCH;
+        char **bkeys = &keys[start];
+        flat_batch_prepare(hs, bkeys, batch, lens, hashes);
+        for(int i = 0; i < batch; i++){
+            int hit = hashset_bloom_maybe(hs, hashes[i]) &&
+                hashset_bloom_result(hs, flat_find_slot(hs, bkeys[i], lens[i], hashes[i]) >= 0);
+            if(found != NULL){
+                found[start + i] = hit;
+            }
+            count += hit;
+        }
+    }
+    return count;
+}
+// Same contract as hashset_contains_many().
+
+int hashset_flat_add_many(hashset_t *hs, char *keys[], int n){
+    int lens[HASHSET_BATCH], hashes[HASHSET_BATCH];
+    int count = 0;
+    for(int start = 0; start < n; start += HASHSET_BATCH){
+        int batch = n - start < HASHSET_BATCH ? n - start : HASHSET_BATCH;
+        flat_batch_prepare(hs, &keys[start], batch, lens, hashes);
+        for(int i = 0; i < batch; i++){
+            count += flat_insert(hs, keys[start + i], lens[i], hashes[i]);
+        }
+    }
+    return count;
+}
+// Same contract as hashset_add_many().
+
+int hashset_flat_remove(hashset_t *hs, char elem[]){
+    int len = strlen(elem);
+    int hash = hs->hashfunc(elem, len);
+    int hole = flat_find_slot(hs, elem, len, hash);
+    if(hole < 0){
+        printf("Elem not present, no changes made\n");
+        return 0;
+    }
+    hashset_snapshot_detach(hs);
+    hs->entries[hs->slots[hole]].len = HASHSET_ENTRY_DEAD;
+    hs->pool_dead += len + 1;
+    hs->elem_count--;
+    int i = hole;
+    while(1){
+        i++;
+        if(i == hs->table_size){
+            i = 0;
+        }
+        if(hs->ctrl[i] == HASHSET_CTRL_EMPTY){
+            break;
+        }
+        int home = hashset_bucket(hs, hs->entries[hs->slots[i]].hash);
+        int stays = hole <= i ? (hole < home && home <= i) : (hole < home || home <= i);
+        if(!stays){
+            hs->ctrl[hole] = hs->ctrl[i];
+            hs->slots[hole] = hs->slots[i];
+            hole = i;
+        }
+    }
+    hs->ctrl[hole] = HASHSET_CTRL_EMPTY;
+    if(hs->entry_len - hs->elem_count > hs->elem_count){
+        hashset_flat_compact(hs);
+    }
+    return 1;
+}
+// Same contract as hashset_remove(). Removal leaves no tombstone in
+// the table: after emptying the element's slot, later slots of the
+// same probe run are scanned and any element whose home index does
+// not lie between the hole and its slot is shifted back into the
+// hole, which then moves to where that element was. The scan ends at
+// the first empty slot, so every remaining element is still reachable
+// by the probe from its home index. The element's entry is marked
+// HASHSET_ENTRY_DEAD to keep the insertion order of the others; once
+// dead entries outnumber live ones hashset_flat_compact() drops them.
+
+void hashset_flat_compact(hashset_t *hs){
+    hashset_snapshot_detach(hs);
+    char *pool = malloc(hs->pool_len - hs->pool_dead + 1);
+    unsigned long pool_len = 0;
+    int live = 0;
+    for(int i = 0; i < hs->entry_len; i++){
+        hashentry_t entry = hs->entries[i];
+        if(entry.len == HASHSET_ENTRY_DEAD){
+            continue;
+        }
+        memcpy(pool + pool_len, HASHSET_KEY(hs, entry.off), entry.len + 1);
+        entry.off = pool_len;
+        pool_len += entry.len + 1;
+        hs->entries[live++] = entry;
+    }
+    free(hs->pool);
+    hs->pool = pool;
+    hs->pool_len = pool_len;
+    hs->pool_cap = pool_len + 1;
+    hs->pool_dead = 0;
+    hs->entry_len = live;
+    hashset_flat_resize(hs, hs->table_size);
+}
+// Drops the entries of removed elements, copying the keys of the
+// rest to a new key pool without the removed keys, then rebuilds the
+// slots since entry indices have changed. Keeps insertion order.
+
+void hashset_flat_resize(hashset_t *hs, int size){
+    hashset_snapshot_detach(hs);
+    free(hs->ctrl);
+    free(hs->slots);
+    hs->table_size = size;
+    hs->mod_magic = hashset_mod_magic(size);
+    hs->ctrl = malloc(size * sizeof(unsigned char));
+    memset(hs->ctrl, HASHSET_CTRL_EMPTY, size);
+    hs->slots = malloc(size * sizeof(int));
+    for(int i = 0; i < hs->entry_len; i++){
+        if(hs->entries[i].len != HASHSET_ENTRY_DEAD){
+            flat_place(hs, i);
+        }
+    }
+}
+// Re-lays out the table with 'size' slots; used by hashset_resize()
+// and so by hashset_expand(). Only the control/slot arrays are
+// rebuilt: entries keep their position and cached hash codes so no
+// keys are copied or re-hashed.
+
+void hashset_flat_rehash(hashset_t *hs){
+    hashset_snapshot_detach(hs);
+    for(int i = 0; i < hs->entry_len; i++){
+        hashentry_t *entry = &hs->entries[i];
+        if(entry->len == HASHSET_ENTRY_DEAD){
+            continue;
+        }
+        entry->hash = hs->hashfunc(HASHSET_KEY(hs, entry->off), entry->len);
+    }
+}
+// Recomputes the cached hash code of every entry after the hash
+// function of 'hs' changed. The caller re-lays out the slots.
+
+void hashset_flat_free_fields(hashset_t *hs){
+    free(hs->entries);
+    free(hs->ctrl);
+    free(hs->slots);
+    hs->entries = NULL;
+    hs->ctrl = NULL;
+    hs->slots = NULL;
+    hs->entry_len = 0;
+    hs->entry_cap = 0;
+    hs->elem_count = 0;
+    hs->table_size = 0;
+    hs->mod_magic = 0;
+}
+// De-allocates the entries and slot arrays of a flat hash set; the
+// key pool is free()'d by hashset_free_fields(). As with
+// hashset_free_fields(), 'hs' itself and its 'engine' field are left
+// alone.
+
+static int flat_next_live(hashset_t *hs, int e){
+    for(e++; e < hs->entry_len; e++){
+        if(hs->entries[e].len != HASHSET_ENTRY_DEAD){
+            return e;
+        }
+    }
+    return -1;
+}
+// Index of the first live entry after 'e', or -1 if there is none.
+
+void hashset_flat_show_structure(hashset_t *hs){
+    double load = ((double)hs->elem_count / (double)hs->table_size);
+    int first = flat_next_live(hs, -1);
+    int last = first;
+    for(int e = first; e != -1; e = flat_next_live(hs, e)){
+        last = e;
+    }
+
+    printf("elem_count: %d\n", hs->elem_count);
+    printf("table_size: %d\n", hs->table_size);
+    if(hs->elem_count == 0){
+        printf("order_first: NULL\n");
+        printf("order_last : NULL\n");
+    } else{
+        printf("order_first: %s\n", HASHSET_KEY(hs, hs->entries[first].off));
+        printf("order_last : %s\n", HASHSET_KEY(hs, hs->entries[last].off));
+    }
+    printf("load_factor: %.4lf\n", load);
+
+    for(int i = 0; i < hs->table_size; i++){
+        printf("[%2d] : ", i);
+        if(hs->ctrl[i] != HASHSET_CTRL_EMPTY){
+            int e = hs->slots[i];
+            hashentry_t *entry = &hs->entries[e];
+            if(e == last){
+                printf("{%d %s >>NULL} ", entry->hash, HASHSET_KEY(hs, entry->off));
+            } else{
+                printf("{%d %s >>%s} ", entry->hash, HASHSET_KEY(hs, entry->off),
+                       HASHSET_KEY(hs, hs->entries[flat_next_live(hs, e)].off));
+            }
+        }
+        printf("\n");
+    }
+}
+// Displays the structure of a flat hash set in the same format as
+// hashset_show_structure(). Each slot holds at most one element so
+// every line shows zero or one node; elements displaced from their
+// home slot by collisions appear in the following slots.
+
+void hashset_flat_stats(hashset_t *hs, hashset_stats_t *stats){
+    long probes = 0;
+    for(int i = 0; i < hs->table_size; i++){
+        int len = 0;
+        if(hs->ctrl[i] != HASHSET_CTRL_EMPTY){
+            int home = hashset_bucket(hs, hs->entries[hs->slots[i]].hash);
+            len = (i - home + hs->table_size) % hs->table_size + 1;
+        }
+        hashset_stats_bin(stats, len);
+        probes += len;
+    }
+    stats->buckets = hs->table_size;
+    stats->avg_probe = hs->elem_count == 0 ? 0.0 : (double) probes / hs->elem_count;
+    if(hs->map != NULL){
+        stats->mapped_bytes = hs->map_len;
+    } else{
+        stats->heap_bytes = hs->table_size * (sizeof(unsigned char) + sizeof(int)) +
+            hs->entry_cap * sizeof(hashentry_t) + hs->pool_cap;
+    }
+}
+// Fills in the layout fields of 'stats' for hashset_stats(). Each
+// occupied slot is counted in the histogram by its probe length, the
+// slots from its elem's home slot to it inclusive, which is the number
+// of control bytes a lookup of that elem checks. A set still mapped
+// from a snapshot allocates nothing on the heap; its whole file is
+// reported as mapped.
+
+int hashset_flat_claim(hashset_t *hs, int e, int limit){
+    hashentry_t *entry = &hs->entries[e];
+    unsigned char h2 = flat_h2(entry->hash);
+    int i = hashset_bucket(hs, entry->hash);
+    while(hs->ctrl[i] != HASHSET_CTRL_EMPTY){
+        if(hs->ctrl[i] == h2){
+            hashentry_t *other = &hs->entries[hs->slots[i]];
+            if(other->hash == entry->hash && other->len == entry->len &&
+               memcmp(HASHSET_KEY(hs, other->off), HASHSET_KEY(hs, entry->off), entry->len) == 0){
+                return 0;
+            }
+        }
+        i++;
+        if(i == limit){
+            return -1;
+        }
+        if(i == hs->table_size){
+            i = 0;
+        }
+    }
+    hs->ctrl[i] = h2;
+    hs->slots[i] = e;
+    return 1;
+}
+// Places entry 'e', whose hash, length and key are already filled in,
+// in the first empty slot of its probe and returns 1. Returns 0
+// without placing it if an entry with the same key is already in the
+// table, or -1 if the probe reaches slot 'limit' first (pass -1 for no
+// limit). Used by hashset_load_parallel() where each thread may only
+// touch the slots of its own range.
@@ -13,69 +13,288 @@ int hashcode(char key[]){
     return hc;
 }
 
-// PROVIDED: Compute a simple hash code for the given character
-// string. The code is "computed" by casting the first 8 characters of
-// the string to a numbers and returning their xor. The empty string
-// has hash code 0. Longer strings will have numbers which are the
-// integer interpretation of up to their first 8 bytes.  ADVANTAGE:
-// constant time to compute the hash code. DISADVANTAGE: poor
-// distribution for long strings; all strings with same first 8 chars
-// hash to the same location.
+// Compute a simple hash code for the given character string: starting
+// from 0, multiplies the code by 31 and adds each character in turn,
+// wrapping around on overflow (the same as Java's String.hashCode()).
+// The empty string has hash code 0. ADVANTAGE: simple and every
+// character contributes. DISADVANTAGE: one byte at a time, and short
+// strings with similar characters get nearby codes that cluster in
+// the table. This is the default hash function of a hash set; see
+// hashset_hash.c for alternatives selectable with hashset_set_hash().
 
 void hashset_init(hashset_t *hs, int table_size){
+    hashset_init_engine(hs, table_size, HASHSET_CHAINED);
+}
+// Initialize the hash set 'hs' to have given size and elem_count
+// 0. Ensures that the 'table' field is initialized to an array of
+// size 'table_size' and is filled with NULLs. Also ensures that the
+// first/last pointers are initialized to NULL. Uses the default
+// HASHSET_CHAINED engine.
+
+void hashset_init_engine(hashset_t *hs, int table_size, hashset_engine_t engine){
     hs->elem_count = 0;
     hs->table_size = table_size;
-    hs->table = malloc(table_size * sizeof(hashnode_t));
-    for(int i = 0; i < table_size; i++){
-        hs->table[i] = NULL;
-    }
+    hs->mod_magic = hashset_mod_magic(table_size);
+    hs->old_magic = 0;
+    hs->table = NULL;
     hs->order_first = NULL;
     hs->order_last = NULL;
+    hs->engine = engine;
+    hs->ctrl = NULL;
+    hs->slots = NULL;
+    hs->entries = NULL;
+    hs->entry_len = 0;
+    hs->entry_cap = 0;
+    hs->incremental = 0;
+    hs->old_table = NULL;
+    hs->old_size = 0;
+    hs->rehash_pos = 0;
+    hs->max_load = 0.0;
+    hs->growth_factor = HASHSET_DEFAULT_GROWTH;
+    hs->sizing = HASHSET_SIZE_PRIME;
+    hs->hashfunc = hashset_hashfuncs[0].func;
+    hs->slabs = NULL;
+    hs->free_nodes = NULL;
+    hs->pool = NULL;
+    hs->pool_len = 0;
+    hs->pool_cap = 0;
+    hs->pool_dead = 0;
+    hs->map = NULL;
+    hs->map_len = 0;
+    hs->bloom = NULL;
+    hs->bloom_blocks = 0;
+    hs->bloom_cap = 0;
+    hs->bloom_checks = 0;
+    hs->bloom_rejects = 0;
+    hs->bloom_false = 0;
+    if(engine == HASHSET_FLAT){
+        hashset_flat_init(hs, table_size);
+        return;
+    }
+    hs->table = calloc(table_size, sizeof(hashnode_t *));
 }
-// Initialize the hash set 'hs' to have given size and elem_count
-// 0. Ensures that the 'table' field is initialized to an array of
-// size 'table_size' and is filled with NULLs. Also ensures that the
-// first/last pointers are initialized to NULL
+// Initialize the hash set 'hs' with the given storage engine. The
+// engine is fixed for the life of the table: hashset_reset() keeps it
+// when re-initializing. Fields not used by the chosen engine are set
+// to NULL/0. The table comes from calloc() so that large tables are
+// handed out as zero pages rather than filled with NULLs one by one.
+// The growth policy starts out as manual expansion with prime sizes
+// and keys are hashed with hashcode().
 
-int hashset_contains(hashset_t *hs, char elem[]){
-    int hash = hashcode(elem);
-    int index = hash % hs->table_size;
-    if(index < 0){
-        index = index * -1;
+static int pow2_at_least(int size){
+    int pow2 = 1;
+    while(pow2 < size){
+        pow2 *= 2;
+    }
+    return pow2;
+}
+// Smallest power of two that is >= size.
+
+void hashset_reset(hashset_t *hs, int table_size){
+    hashset_t saved = *hs;
+    if(saved.sizing == HASHSET_SIZE_POW2){
+        table_size = pow2_at_least(table_size);
     }
-    hashnode_t *node = hs->table[index];
+    hashset_free_fields(hs);
+    hashset_init_engine(hs, table_size, saved.engine);
+    hs->incremental = saved.incremental;
+    hs->max_load = saved.max_load;
+    hs->growth_factor = saved.growth_factor;
+    hs->sizing = saved.sizing;
+    hs->hashfunc = saved.hashfunc;
+    if(saved.bloom != NULL){
+        hashset_set_bloom(hs, 1);
+    }
+}
+// Removes all elements from 'hs' and re-initializes it with the given
+// table size. Unlike a free_fields()/init() pair this keeps the
+// engine and settings such as incremental rehashing, the growth
+// policy, the hash function and whether there is a Bloom filter. With
+// power of two sizing, 'table_size' is rounded up to a power of two.
+// Used by hashset_load() and the 'clear' command.
+
+int hashset_engine_parse(char *name){
+    if(strcmp(name, "chained") == 0){
+        return HASHSET_CHAINED;
+    }
+    if(strcmp(name, "flat") == 0){
+        return HASHSET_FLAT;
+    }
+    return -1;
+}
+// Returns the hashset_engine_t named by 'name' ("chained" or "flat")
+// or -1 if the name is not recognized.
+
+char *hashset_engine_name(hashset_engine_t engine){
+    return engine == HASHSET_FLAT ? "flat" : "chained";
+}
+// Returns the name of the given engine as accepted by
+// hashset_engine_parse().
+
+unsigned long hashset_mod_magic(int size){
+    if(size <= 0){
+        return 0;
+    }
+    return 0xFFFFFFFFFFFFFFFFUL / size + 1;
+}
+// Returns the multiplier that lets bucket_in() compute 'x % size'
+// without a division: ceil(2^64 / size), wrapping to 0 for size 1.
+// Computed once per table size and kept in the hash set.
+
+static int bucket_in(hashset_t *hs, int hash, int size, unsigned long magic){
+    if(hs->sizing == HASHSET_SIZE_POW2){
+        return (unsigned int) hash & (size - 1);
+    }
+    unsigned int mag = hash < 0 ? 0u - (unsigned int) hash : (unsigned int) hash;
+#ifdef __SIZEOF_INT128__
+    unsigned long frac = magic * mag;
+    return (int) (((unsigned __int128) frac * (unsigned int) size) >> 64);
+#else
+    return (int) (mag % (unsigned int) size);
+#endif
+}
+// Index of a key with the given hash code in a table of 'size'
+// buckets whose magic number is 'magic'. Used directly for the old
+// table during a rehash. For prime sizing this is |hash| % size,
+// computed with Lemire's "fastmod": the low 64 bits of magic*|hash|
+// are the fractional part of |hash|/size, and multiplying that by
+// size and keeping the high 64 bits gives the remainder exactly for
+// every 32-bit |hash| and size.
+
+int hashset_bucket(hashset_t *hs, int hash){
+    return bucket_in(hs, hash, hs->table_size, hs->mod_magic);
+}
+// Returns the table index for a key with the given hash code. With
+// prime sizing this is 'hash modulo table_size' with negative results
+// negated, computed by multiplication with the table's precomputed
+// `mod_magic` rather than a division; with power of two sizing it is
+// the low bits of the hash selected by masking with table_size-1.
+// Shared by both engines so that a key lands at the same home index
+// in each.
+
+int hashset_hash(hashset_t *hs, char key[]){
+    return hs->hashfunc(key, strlen(key));
+}
+// Returns the hash code of 'key' under the hash function of 'hs'.
+
+unsigned int hashset_pool_add(hashset_t *hs, char key[], int len){
+    if(hs->pool_len + len + 1 > hs->pool_cap){
+        unsigned long cap = hs->pool_cap == 0 ? HASHSET_POOL_MIN : hs->pool_cap;
+        while(hs->pool_len + len + 1 > cap){
+            cap *= 2;
+        }
+        hs->pool = realloc(hs->pool, cap);
+        hs->pool_cap = cap;
+    }
+    unsigned int off = hs->pool_len;
+    memcpy(hs->pool + off, key, len + 1);
+    hs->pool_len += len + 1;
+    return off;
+}
+// Appends the 'len' characters of 'key' and its '\0' to the key pool
+// of 'hs' and returns the offset they start at. The pool is a single
+// block that doubles when full, so keys are referred to by offset
+// (see HASHSET_KEY()) rather than by pointer, which realloc() would
+// invalidate. Keys of any length are stored in len+1 bytes. The pool
+// only grows; it is free()'d along with the rest of the set.
+
+static hashnode_t *chain_find(hashset_t *hs, hashnode_t *node, char key[], int len, int hash){
     while(node != NULL){
-        if(strcmp(node->elem, elem) == 0){
-            return 1;
+        if(node->hash == hash && node->elem_len == len &&
+           memcmp(HASHSET_KEY(hs, node->elem_off), key, len) == 0){
+            return node;
         }
         node = node->table_next;
     }
-    return 0;
+    return NULL;
+}
+// Searches a single bucket list for 'key', returning its node or
+// NULL. The cached hash and length of each node are compared first so
+// the pool is only read for a node that is almost certainly a match.
 
+static hashnode_t *chained_find(hashset_t *hs, char key[], int len, int hash){
+    if(hs->old_table != NULL){
+        hashset_rehash_step(hs, HASHSET_REHASH_STEP);
+    }
+    hashnode_t *node = chain_find(hs, hs->table[hashset_bucket(hs, hash)], key, len, hash);
+    if(node == NULL && hs->old_table != NULL){
+        int old_index = bucket_in(hs, hash, hs->old_size, hs->old_magic);
+        if(old_index >= hs->rehash_pos){
+            node = chain_find(hs, hs->old_table[old_index], key, len, hash);
+        }
+    }
+    return node;
+}
+// Finds the node holding 'key', whose length and hash code the caller
+// has already computed, or returns NULL. Shared by hashset_contains()
+// and hashset_add() so an add hashes its elem only once.
+
+int hashset_contains(hashset_t *hs, char elem[]){
+    if(hs->engine == HASHSET_FLAT){
+        return hashset_flat_contains(hs, elem);
+    }
+    int len = strlen(elem);
+    int hash = hs->hashfunc(elem, len);
+    if(!hashset_bloom_maybe(hs, hash)){
+        return 0;
+    }
+    return hashset_bloom_result(hs, chained_find(hs, elem, len, hash) != NULL);
 }
 // Returns 1 if the parameter `elem` is in the hash set and 0
-// otherwise. Uses hashcode() and field `table_size` to determine
+// otherwise. Uses hashset_hash() and field `table_size` to determine
 // which index in table to search.  Iterates through the list at that
-// table index using strcmp() to check for `elem`. NOTE: The
-// `hashcode()` function may return positive or negative
-// values. Negative values are negated to make them positive. The
-// "bucket" (index in hs->table) for `elem` is determined by with
-// 'hashcode(key) modulo table_size'.
+// table index comparing hash codes, lengths and then characters to
+// check for `elem`. NOTE: The hash function may return positive or
+// negative values. Negative values are negated to make them positive.
+// The "bucket" (index in hs->table) for `elem` is determined by with
+// 'hash(key) modulo table_size'. While an incremental rehash is
+// pending, first migrates a few old buckets and then also checks the
+// old table if `elem` maps to a bucket that has not moved yet. If the
+// set has a Bloom filter it is consulted first and the table is only
+// searched when the filter cannot rule `elem` out.
 
-int hashset_add(hashset_t *hs, char elem[]){
-    if(hashset_contains(hs, elem)){
-        printf("Elem already present, no changes made\n");
+static hashnode_t *node_alloc(hashset_t *hs){
+    if(hs->free_nodes != NULL){
+        hashnode_t *node = hs->free_nodes;
+        hs->free_nodes = node->table_next;
+        return node;
+    }
+    hashslab_t *slab = hs->slabs;
+    if(slab == NULL || slab->used == slab->cap){
+        int cap = slab == NULL ? HASHSET_SLAB_MIN : 2 * slab->cap;
+        if(cap > HASHSET_SLAB_MAX){
+            cap = HASHSET_SLAB_MAX;
+        }
+        slab = malloc(sizeof(hashslab_t) + cap * sizeof(hashnode_t));
+        slab->cap = cap;
+        slab->used = 0;
+        slab->next = hs->slabs;
+        hs->slabs = slab;
+    }
+    return &slab->nodes[slab->used++];
+}
+// Reuses the node of a removed element if there is one. Otherwise
+// hands out the next unused node of the newest slab, allocating a new
+// slab twice the size of the last (up to HASHSET_SLAB_MAX nodes) when
+// it is full. Nodes are never free()'d individually: they go away
+// with their slab in hashset_free_fields(). Consecutive adds get
+// adjacent nodes so walking the order list reads memory sequentially.
+
+static int chained_insert(hashset_t *hs, char elem[], int len, int hash){
+    if(chained_find(hs, elem, len, hash) != NULL){
         return 0;
     }
-    int hash = hashcode(elem);
-    int index = hash % hs->table_size;
-    if(index < 0){
-        index = index * -1;
+    if(hs->max_load > 0 && hs->elem_count + 1 > hs->max_load * hs->table_size){
+        hashset_expand(hs);
     }
-    hashnode_t *node = malloc(sizeof(hashnode_t));
-    strcpy(node->elem, elem);
+    int index = hashset_bucket(hs, hash);
+    hashnode_t *node = node_alloc(hs);
+    node->elem_off = hashset_pool_add(hs, elem, len);
+    node->elem_len = len;
+    node->hash = hash;
     node->table_next = hs->table[index];
     node->order_next = NULL;
+    node->order_prev = hs->order_last;
     hs->table[index] = node;
     if(hs->order_first != NULL){
         hs->order_last->order_next = node;
@@ -84,6 +303,25 @@ int hashset_add(hashset_t *hs, char elem[]){
     }
     hs->order_last = node;
     hs->elem_count++;
+    if(hs->bloom != NULL){
+        hashset_bloom_add(hs, hash);
+    }
+    return 1;
+}
+// Adds 'elem', whose length and hash code the caller has computed, to
+// a chained set unless it is already present. Returns 1 if it was
+// added and 0 otherwise without printing anything. Shared by
+// hashset_add() and hashset_add_many().
+
+int hashset_add(hashset_t *hs, char elem[]){
+    if(hs->engine == HASHSET_FLAT){
+        return hashset_flat_add(hs, elem);
+    }
+    int len = strlen(elem);
+    if(!chained_insert(hs, elem, len, hs->hashfunc(elem, len))){
+        printf("Elem already present, no changes made\n");
+        return 0;
+    }
     return 1;
 
 }
@@ -91,42 +329,273 @@ int hashset_add(hashset_t *hs, char elem[]){
 
 
 // If the element is already present in the hash set, makes no changes
-// to the hash set and returns 0. hashset_contains() may be used for
-// this. Otherwise determines the bucket to add `elem` at via the same
-// process as in hashset_contains() and adds it to the FRONT of the
-// list at that table index. Adjusts the `hs->order_last` pointer to
-// append the new element to the ordered list of elems. If this is the
-// first element added, also adjsuts the `hs->first` pointer. Updates the
-// `elem_count` field and returns 1 to indicate a successful addition.
+// to the hash set and returns 0. Otherwise determines the bucket to
+// add `elem` at via the same process as in hashset_contains() and
+// adds it to the FRONT of the list at that table index. The node
+// comes from the set's slabs via node_alloc() and the elem string is
+// copied to the key pool; the node keeps its offset, length and hash
+// code, so elems of any length are stored without truncation. Adjusts
+// the `hs->order_last` pointer to append the new element to the
+// ordered list of elems. If this is the first element added, also
+// adjsuts the `hs->first` pointer. Updates the `elem_count` field and
+// returns 1 to indicate a successful addition.
 //
 // NOTE: Adding elems at the front of each bucket list allows much
 // simplified logic that does not need any looping/iteration.
 
+static hashnode_t *chain_unlink(hashset_t *hs, hashnode_t **link, char key[], int len, int hash){
+    while(*link != NULL){
+        hashnode_t *node = *link;
+        if(node->hash == hash && node->elem_len == len &&
+           memcmp(HASHSET_KEY(hs, node->elem_off), key, len) == 0){
+            *link = node->table_next;
+            return node;
+        }
+        link = &node->table_next;
+    }
+    return NULL;
+}
+// Searches the bucket list whose head is '*link' for 'key' and, if
+// found, unlinks its node by overwriting the pointer to it, whether
+// that is the bucket head or the previous node's 'table_next'.
+// Returns the unlinked node or NULL.
+
+static void pool_compact(hashset_t *hs){
+    char *pool = malloc(hs->pool_len - hs->pool_dead + 1);
+    unsigned long pool_len = 0;
+    for(hashnode_t *node = hs->order_first; node != NULL; node = node->order_next){
+        memcpy(pool + pool_len, HASHSET_KEY(hs, node->elem_off), node->elem_len + 1);
+        node->elem_off = pool_len;
+        pool_len += node->elem_len + 1;
+    }
+    free(hs->pool);
+    hs->pool = pool;
+    hs->pool_len = pool_len;
+    hs->pool_cap = pool_len + 1;
+    hs->pool_dead = 0;
+}
+// Copies the keys of the elems still in a chained set to a new pool
+// in insertion order and updates each node's offset, dropping the
+// bytes of removed keys.
+
+int hashset_remove(hashset_t *hs, char elem[]){
+    if(hs->engine == HASHSET_FLAT){
+        return hashset_flat_remove(hs, elem);
+    }
+    if(hs->old_table != NULL){
+        hashset_rehash_step(hs, HASHSET_REHASH_STEP);
+    }
+    int len = strlen(elem);
+    int hash = hs->hashfunc(elem, len);
+    hashnode_t *node = chain_unlink(hs, &hs->table[hashset_bucket(hs, hash)], elem, len, hash);
+    if(node == NULL && hs->old_table != NULL){
+        int old_index = bucket_in(hs, hash, hs->old_size, hs->old_magic);
+        if(old_index >= hs->rehash_pos){
+            node = chain_unlink(hs, &hs->old_table[old_index], elem, len, hash);
+        }
+    }
+    if(node == NULL){
+        printf("Elem not present, no changes made\n");
+        return 0;
+    }
+    if(node->order_prev != NULL){
+        node->order_prev->order_next = node->order_next;
+    } else{
+        hs->order_first = node->order_next;
+    }
+    if(node->order_next != NULL){
+        node->order_next->order_prev = node->order_prev;
+    } else{
+        hs->order_last = node->order_prev;
+    }
+    node->table_next = hs->free_nodes;
+    hs->free_nodes = node;
+    hs->elem_count--;
+    hs->pool_dead += len + 1;
+    if(hs->pool_dead > hs->pool_len / 2){
+        pool_compact(hs);
+    }
+    return 1;
+}
+// If `elem` is not in the hash set, prints a message, makes no
+// changes and returns 0. Otherwise removes it and returns 1. The node
+// is unlinked from its bucket list in one pass over the bucket, and
+// from the insertion order list in O(1) using its `order_prev` and
+// `order_next` neighbors, so removal never scans the order list. The
+// node goes on `free_nodes` for reuse by a later add. The key's bytes
+// in the pool are dead until the pool is compacted, which happens
+// once they make up more than half of it; the cost of compaction is
+// spread over the removals that made it necessary.
+
+static void batch_prepare(hashset_t *hs, char *keys[], int n, int lens[], int hashes[]){
+    for(int i = 0; i < n; i++){
+        lens[i] = strlen(keys[i]);
+        hashes[i] = hs->hashfunc(keys[i], lens[i]);
+        HASHSET_PREFETCH(&hs->table[hashset_bucket(hs, hashes[i])]);
+    }
+    for(int i = 0; i < n; i++){
+        HASHSET_PREFETCH(hs->table[hashset_bucket(hs, hashes[i])]);
+    }
+}
+// First two stages of a chained batch: hashes every key and prefetches
+// its bucket slot, then, with those loads in flight together, reads
+// each slot and prefetches the first node of the bucket. By the time
+// the batch is resolved one key at a time most of the memory it
+// touches is already in cache.
+
+int hashset_contains_many(hashset_t *hs, char *keys[], int n, int found[]){
+    if(hs->engine == HASHSET_FLAT){
+        return hashset_flat_contains_many(hs, keys, n, found);
+    }
+    hashset_rehash_finish(hs);
+    int lens[HASHSET_BATCH], hashes[HASHSET_BATCH];
+    int count = 0;
+    for(int start = 0; start < n; start += HASHSET_BATCH){
+        int batch = n - start < HASHSET_BATCH ? n - start : HASHSET_BATCH;
+        char **bkeys = &keys[start];
+        batch_prepare(hs, bkeys, batch, lens, hashes);
+        for(int i = 0; i < batch; i++){
+            int hit = 0;
+            if(hashset_bloom_maybe(hs, hashes[i])){
+                hashnode_t *head = hs->table[hashset_bucket(hs, hashes[i])];
+                hit = hashset_bloom_result(hs, chain_find(hs, head, bkeys[i], lens[i], hashes[i]) != NULL);
+            }
+            if(found != NULL){
+                found[start + i] = hit;
+            }
+            count += hit;
+        }
+    }
+    return count;
+}
+// Looks up 'n' keys at once and returns how many are in the set. If
+// 'found' is not NULL, found[i] is set to 1 or 0 for keys[i]. Keys are
+// processed in groups of HASHSET_BATCH: the whole group is hashed and
+// its buckets prefetched before any is searched, so the cache misses
+// of different keys overlap instead of being taken one after another.
+// Keys a Bloom filter rules out are not searched. Completes any
+// pending incremental rehash first.
+
+int hashset_add_many(hashset_t *hs, char *keys[], int n){
+    if(hs->engine == HASHSET_FLAT){
+        return hashset_flat_add_many(hs, keys, n);
+    }
+    hashset_rehash_finish(hs);
+    int lens[HASHSET_BATCH], hashes[HASHSET_BATCH];
+    int count = 0;
+    for(int start = 0; start < n; start += HASHSET_BATCH){
+        int batch = n - start < HASHSET_BATCH ? n - start : HASHSET_BATCH;
+        batch_prepare(hs, &keys[start], batch, lens, hashes);
+        for(int i = 0; i < batch; i++){
+            count += chained_insert(hs, keys[start + i], lens[i], hashes[i]);
+        }
+    }
+    return count;
+}
+// Adds 'n' keys in order, as if by hashset_add() on each, and returns
+// how many were added. Keys already present, including repeats within
+// 'keys', are skipped without the message hashset_add() prints. Uses
+// the same hash-then-prefetch stages as hashset_contains_many(); an
+// expansion in the middle of a group only makes the remaining
+// prefetches useless, as each key's bucket is recomputed when it is
+// added.
+
+int hashset_batch_file(hashset_t *hs, char *filename, int add){
+    FILE *fp = fopen(filename, "r");
+    if(fp == NULL){
+        printf("ERROR: could not open file '%s'\n", filename);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+    char *text = malloc(size + 1);
+    size = fread(text, 1, size, fp);
+    text[size] = '\0';
+    fclose(fp);
+
+    int cap = 64, n = 0;
+    char **keys = malloc(cap * sizeof(char *));
+    char *tok = strtok(text, " \t\r\n");
+    while(tok != NULL){
+        if(n == cap){
+            cap *= 2;
+            keys = realloc(keys, cap * sizeof(char *));
+        }
+        keys[n++] = tok;
+        tok = strtok(NULL, " \t\r\n");
+    }
+    int count;
+    if(add){
+        count = hashset_add_many(hs, keys, n);
+        printf("added %d of %d keys\n", count, n);
+    } else{
+        count = hashset_contains_many(hs, keys, n, NULL);
+        printf("found %d of %d keys\n", count, n);
+    }
+    free(keys);
+    free(text);
+    return count;
+}
+// Reads every whitespace separated key in 'filename' and passes them
+// all to hashset_add_many() if 'add' is 1 or hashset_contains_many()
+// if it is 0, then prints how many were added or found. The file is
+// read with one fread() and split in place so keys are not copied
+// before the batch call. Returns that count, or -1 after printing an
+// error if the file cannot be opened.
+
 void hashset_free_fields(hashset_t *hs){
-    hashnode_t *node = hs->order_first;
-    while(node != NULL){
-        hashnode_t *nextNode = node->order_next;
-        free(node);
-        node = nextNode;
+    hashset_snapshot_unmap(hs);
+    free(hs->bloom);
+    hs->bloom = NULL;
+    free(hs->pool);
+    hs->pool = NULL;
+    hs->pool_len = 0;
+    hs->pool_cap = 0;
+    hs->pool_dead = 0;
+    if(hs->engine == HASHSET_FLAT){
+        hashset_flat_free_fields(hs);
+        return;
+    }
+    while(hs->slabs != NULL){
+        hashslab_t *next = hs->slabs->next;
+        free(hs->slabs);
+        hs->slabs = next;
     }
     free(hs->table);
+    free(hs->old_table);
+    hs->free_nodes = NULL;
+    hs->table = NULL;
+    hs->old_table = NULL;
+    hs->old_size = 0;
+    hs->rehash_pos = 0;
     hs->elem_count = 0;
     hs->table_size = 0;
+    hs->mod_magic = 0;
+    hs->old_magic = 0;
     hs->order_first = NULL;
     hs->order_last = NULL;
 }
 
 
 
-// De-allocates nodes/table for `hs`. Iterates through the ordered
-// list of the hash set starting at the `order_first` field and
-// de-allocates all nodes in the list. Also free's the `table`
-// field. Sets all relevant fields to 0 or NULL as appropriate to
-// indicate that the hash set has no more usable space. Does NOT
-// attempt to de-allocate the `hs` itself as it may not be
-// heap-allocated (e.g. in the stack or a global).
+// De-allocates nodes/table for `hs`. Nodes live in slabs (see
+// node_alloc()) so this free()'s each slab rather than each node,
+// taking time proportional to the number of slabs, not elems. Also
+// free's the key pool, any Bloom filter and the `table` field, or
+// unmaps the snapshot a flat set was loaded from. Sets all relevant
+// fields to 0 or NULL as appropriate to indicate that the hash set
+// has no more usable space. Does NOT attempt to de-allocate the `hs`
+// itself as it may not be heap-allocated (e.g. in the stack or a
+// global). The `engine` field is left alone so the set can be
+// re-initialized with the same one.
 
 void hashset_show_structure(hashset_t *hs){
+    if(hs->engine == HASHSET_FLAT){
+        hashset_flat_show_structure(hs);
+        return;
+    }
+    hashset_rehash_finish(hs);
     double load = ((double)hs->elem_count / (double)hs->table_size);
     
     printf("elem_count: %d\n", hs->elem_count);
@@ -134,12 +603,12 @@ void hashset_show_structure(hashset_t *hs){
     if(hs->order_first == NULL){
         printf("order_first: NULL\n");
     } else{
-        printf("order_first: %s\n", hs->order_first->elem);
+        printf("order_first: %s\n", HASHSET_KEY(hs, hs->order_first->elem_off));
     }
     if(hs->order_last == NULL){
         printf("order_last : NULL\n");
     } else{
-        printf("order_last : %s\n", hs->order_last->elem);
+        printf("order_last : %s\n", HASHSET_KEY(hs, hs->order_last->elem_off));
     }
     
     
@@ -149,10 +618,11 @@ void hashset_show_structure(hashset_t *hs){
         printf("[%2d] : ", i);
         hashnode_t *node = hs->table[i];
         while(node != NULL){
-            if(node->order_next->elem == NULL){
-                printf("{%d %s >>NULL} ", hashcode(node->elem), node->elem);
+            if(node->order_next == NULL){
+                printf("{%d %s >>NULL} ", node->hash, HASHSET_KEY(hs, node->elem_off));
             } else{
-                printf("{%d %s >>%s} ", hashcode(node->elem), node->elem, node->order_next->elem);
+                printf("{%d %s >>%s} ", node->hash, HASHSET_KEY(hs, node->elem_off),
+                       HASHSET_KEY(hs, node->order_next->elem_off));
             }
             
             node = node->table_next;
@@ -164,9 +634,10 @@ void hashset_show_structure(hashset_t *hs){
 
 // Displays detailed structure of the hash set. Shows stats for the
 // hash set as below including the load factor (element count divided
-// by table_size) to 4 digits of accuracy.  Then shows each table
-// array index ("bucket") on its own line with the linked list of
-// elems in the bucket on the same line. 
+// by table_size) to 4 digits of accuracy. Any pending incremental
+// rehash is completed first so the table shown is whole.  Then shows
+// each table array index ("bucket") on its own line with the linked
+// list of elems in the bucket on the same line.
 // 
 // EXAMPLE:
 // elem_count: 4
@@ -187,27 +658,28 @@ void hashset_show_structure(hashset_t *hs){
 //    |          |       |        
 //    |          |       +-> order_next->elem OR NULL if last node
 //    |          +->`elem` string     
-//    +-> hashcode("IceT"), print using format "%ld" for 64-bit longs
+//    +-> hash code of "IceT" under the set's hash function, format "%d"
 // 
 
 void hashset_write_elems_ordered(hashset_t *hs, FILE *out){
-    hashnode_t *node = hs->order_first;
+    hashset_iter_t it;
+    hashset_iter_init(&it, hs, HASHSET_ITER_ORDER);
     int count = 1;
-    while(node != NULL){
-        fprintf(out, "   %d %s\n", count, node->elem);
-        node = node->order_next;
+    for(char *key = hashset_iter_next(&it); key != NULL; key = hashset_iter_next(&it)){
+        fprintf(out, "   %d %s\n", count, key);
         count++;
     }
 }
 // Outputs all elements of the hash set according to the order they
-// were added. Starts at the `order_first` field and iterates through
-// the list defined there. Each element is printed on its own line
-// preceded by its add position with 1 for the first elem, 2 for the
-// second, etc. Prints output to `FILE *out` which should be an open
-// handle. NOTE: the output can be printed to the terminal screen by
-// passing in the `stdout` file handle for `out`.
+// were added, visiting them with a HASHSET_ITER_ORDER cursor. Each
+// element is printed on its own line preceded by its add position
+// with 1 for the first elem, 2 for the second, etc. Prints output to
+// `FILE *out` which should be an open handle. NOTE: the output can be
+// printed to the terminal screen by passing in the `stdout` file
+// handle for `out`.
 
 void hashset_save(hashset_t *hs, char *filename){
+    hashset_snapshot_detach(hs);
     FILE *fp = fopen(filename, "w");
     if(fp == NULL){
         printf("ERROR: could not open file '%s'\n", filename);
@@ -220,7 +692,9 @@ void hashset_save(hashset_t *hs, char *filename){
 // Writes the given hash set to the given `filename` so that it can be
 // loaded later.  Opens the file and writes its 'table_size' and
 // 'elem_count' to the file. Then uses the hashset_write_elems_ordered()
-// function to output all elems in the hash set into the file.
+// function to output all elems in the hash set into the file. A set
+// loaded from a snapshot is copied off its mapping first, as in
+// hashset_save_snapshot(), in case 'filename' is the mapped file.
 // EXAMPLE FILE:
 // 
 // 5 6
@@ -242,16 +716,25 @@ int hashset_load(hashset_t *hs, char *filename){
         printf("load failed\n");
         return 0;
     }
+    char magic[sizeof(HASHSET_SNAP_MAGIC) - 1];
+    if(fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+       memcmp(magic, HASHSET_SNAP_MAGIC, sizeof(magic)) == 0){
+        fclose(fp);
+        return hashset_load_snapshot(hs, filename);
+    }
+    rewind(fp);
     int count;
     int size;
     fscanf(fp,"%d %d", &size, &count);
-    hashset_free_fields(hs);
-    hashset_init(hs, size);
+    hashset_reset(hs, size);
 
     for(int i = 0; i < count; i++){
-        char elem[64];
-        fscanf(fp, " %*d %s", elem);
+        char *elem = NULL;
+        if(fscanf(fp, " %*d %ms", &elem) != 1){
+            break;
+        }
         hashset_add(hs, elem);
+        free(elem);
     }
 
     fclose(fp);
@@ -267,60 +750,414 @@ int hashset_load(hashset_t *hs, char *filename){
 // current hash set `hs`, initializes a new one based on the size
 // present in the file, and adds all elems from the file into the new
 // hash set. Ignores the indices at the start of each line and uses
-// hashset_add() to insert elems in the order they appear in the
-// file. Returns 1 on successful loading (FIXED: previously indicated
-// a different return value on success) . This function does no error
-// checking of the contents of the file so if they are corrupted, it
-// may cause an application to crash or loop infinitely.
+// hashset_add() to insert elems in the order they appear in the file.
+// Elems may be of any length: each is read into a buffer scanf()
+// sizes to fit. Returns 1 on successful loading (FIXED: previously
+// indicated a different return value on success) . This function does
+// no error checking of the contents of the file so if they are
+// corrupted, it may cause an application to crash or loop infinitely.
+// A file that starts with HASHSET_SNAP_MAGIC is instead handed to
+// hashset_load_snapshot(), which maps it in place.
 
-int next_prime(int num){
-    int i;
-    while(1){
-        
-        for(i = 2; i <= num/2; i++){
-            if (num % i == 0){
-                break;
+static unsigned char sieve_composite[HASHSET_SIEVE_LIMIT + 1];
+static int sieve_primes[HASHSET_SIEVE_LIMIT / 8];
+static int sieve_count = 0;
+
+static void sieve_build(){
+    for(int i = 2; i * i <= HASHSET_SIEVE_LIMIT; i++){
+        if(!sieve_composite[i]){
+            for(int j = i * i; j <= HASHSET_SIEVE_LIMIT; j += i){
+                sieve_composite[j] = 1;
             }
         }
-        
-        if (i > num/2){
-            return num;
+    }
+    for(int i = 2; i <= HASHSET_SIEVE_LIMIT; i++){
+        if(!sieve_composite[i]){
+            sieve_primes[sieve_count++] = i;
+        }
+    }
+}
+// Sieve of Eratosthenes over 0..HASHSET_SIEVE_LIMIT, run once on the
+// first call to next_prime(). Fills 'sieve_composite' for direct
+// lookups of small numbers and 'sieve_primes' with the 6542 primes in
+// that range, which include every possible prime factor of an int.
+
+static int is_prime(int num){
+    if(num <= HASHSET_SIEVE_LIMIT){
+        return !sieve_composite[num];
+    }
+    for(int k = 0; k < sieve_count; k++){
+        int p = sieve_primes[k];
+        if((long) p * p > num){
+            return 1;
+        }
+        if(num % p == 0){
+            return 0;
         }
+    }
+    return 1;
+}
+// Returns 1 if 'num' >= 2 is prime. Small numbers are looked up in
+// the sieve; larger ones are trial divided by the sieved primes up to
+// their square root only.
+
+int next_prime(int num){
+    if(sieve_count == 0){
+        sieve_build();
+    }
+    if(num < 2){
+        return num;
+    }
+    while(!is_prime(num)){
         num++;
     }
+    return num;
 }
 // If 'num' is a prime number, returns 'num'. Otherwise, returns the
-// first prime that is larger than 'num'. Uses a simple algorithm to
-// calculate primeness: check if any number between 2 and (num/2)
-// divide num. If none do, it is prime. If not, tries next odd number
-// above num. Loops this approach until a prime number is located and
-// returns this. Used to ensure that hash table_size stays prime which
-// theoretically distributes elements better among the array indices
-// of the table.
+// first prime that is larger than 'num'. Numbers below 2 are returned
+// unchanged. Primeness is checked against a table of primes sieved
+// once up to HASHSET_SIEVE_LIMIT: small numbers are a single lookup
+// and larger ones need at most ~4800 trial divisions, so finding the
+// next prime above even INT_MAX/2 takes microseconds rather than the
+// num/2 divisions per candidate of plain trial division. Used to
+// ensure that hash table_size stays prime which theoretically
+// distributes elements better among the array indices of the table.
 
-void hashset_expand(hashset_t *hs){
-int size = next_prime(2 * hs->table_size + 1);
-hashset_t new_hs;
-hashset_init(&new_hs, size);
-hashnode_t *node = hs->order_first;
-while(node != NULL){
-    hashset_add(&new_hs, node->elem);
-    node = node->order_next;
+static void relink(hashset_t *hs, hashnode_t *node){
+    int index = hashset_bucket(hs, node->hash);
+    node->table_next = hs->table[index];
+    hs->table[index] = node;
 }
-hashset_free_fields(hs);
-*hs = new_hs;
+// Moves an existing node to the front of its bucket in the current
+// table using its cached hash code. Nodes are never re-allocated and
+// keys never re-hashed when the table grows.
+
+int hashset_next_size(hashset_t *hs){
+    int grown = (int) (hs->growth_factor * hs->table_size);
+    if(grown <= hs->table_size){
+        grown = hs->table_size + 1;
+    }
+    if(hs->sizing == HASHSET_SIZE_POW2){
+        return pow2_at_least(grown);
+    }
+    return next_prime(grown + 1);
+}
+// Returns the table size hashset_expand() grows to under the current
+// policy: at least 'growth_factor' times table_size, rounded to the
+// next prime or power of two. With the default factor of 2 and prime
+// sizing this is next_prime(2*table_size+1).
+
+void hashset_resize(hashset_t *hs, int size){
+    if(hs->engine == HASHSET_FLAT){
+        hashset_flat_resize(hs, size);
+        return;
+    }
+    hashset_rehash_finish(hs);
+    if(hs->incremental){
+        hs->old_table = hs->table;
+        hs->old_size = hs->table_size;
+        hs->old_magic = hs->mod_magic;
+        hs->rehash_pos = 0;
+        hs->table = calloc(size, sizeof(hashnode_t *));
+        hs->table_size = size;
+        hs->mod_magic = hashset_mod_magic(size);
+        return;
+    }
+    free(hs->table);
+    hs->table = calloc(size, sizeof(hashnode_t *));
+    hs->table_size = size;
+    hs->mod_magic = hashset_mod_magic(size);
+    for(hashnode_t *node = hs->order_first; node != NULL; node = node->order_next){
+        relink(hs, node);
+    }
+}
+// Moves all elems of 'hs' into a table of the given size which must
+// suit the current sizing policy.
+//
+// By default the transfer happens immediately: the old table is
+// free()'d and every node is relinked into the new table by walking
+// the insertion order list, which yields the same bucket layout as
+// re-adding each elem. Nodes themselves are kept, so no elem is
+// copied, malloc()'d or compared.
+//
+// If `incremental` is set, the old table is kept as `old_table` and
+// its buckets are migrated a few at a time by later add/contains
+// calls (see hashset_rehash_step()) so no single operation pays for
+// the whole transfer. Buckets migrated this way hold their nodes in
+// reverse of the order they had in the old bucket.
+
+void hashset_expand(hashset_t *hs){
+    hashset_resize(hs, hashset_next_size(hs));
+    if(hs->bloom != NULL){
+        hashset_bloom_build(hs);
+    }
 }
 // Allocates a new, larger area of memory for the `table` field and
-// re-adds all current elems to it. The size of the new table is
-// next_prime(2*table_size+1) which keeps the size prime.  After
-// allocating the new table, all table entries are initialized to NULL
-// then the old table is iterated through and all elems are added to
-// the new table according to their hash code. The memory for the old
-// table is de-allocated and the new table assigned to the hash set
-// fields "table" and "table_size".  This function increases
-// "table_size" while keeping "elem_count" the same thereby reducing
-// the load of the hash table. Ensures that the memory associated with
-// the old table is free()'d. Makes NO special effort to preserve old
-// nodes: re-adds everything into the new table and then frees the old
-// one along with its nodes. Uses functions such as hashset_init(),
-// hashset_add(), hashset_free_fields() to accomplish the transfer.
\ No newline at end of file
+// moves all current elems to it using hashset_resize(). The size of
+// the new table is given by hashset_next_size(); with the default
+// policy this is next_prime(2*table_size+1) which keeps the size
+// prime. This function increases "table_size" while keeping
+// "elem_count" the same thereby reducing the load of the hash table.
+// Called by hashset_add() when the growth policy has a `max_load`.
+// A Bloom filter is rebuilt for the new size, which also clears the
+// bits of removed elems.
+
+void hashset_rehash_step(hashset_t *hs, int buckets){
+    while(hs->old_table != NULL && buckets > 0){
+        hashnode_t *node = hs->old_table[hs->rehash_pos];
+        while(node != NULL){
+            hashnode_t *next = node->table_next;
+            relink(hs, node);
+            node = next;
+        }
+        hs->old_table[hs->rehash_pos] = NULL;
+        hs->rehash_pos++;
+        buckets--;
+        if(hs->rehash_pos == hs->old_size){
+            free(hs->old_table);
+            hs->old_table = NULL;
+            hs->old_size = 0;
+            hs->old_magic = 0;
+            hs->rehash_pos = 0;
+        }
+    }
+}
+// Migrates up to `buckets` buckets of a pending incremental rehash
+// from `old_table` into `table` by relinking their nodes. Frees the
+// old table once its last bucket has moved. Does nothing if no rehash
+// is pending.
+
+void hashset_rehash_finish(hashset_t *hs){
+    if(hs->old_table != NULL){
+        hashset_rehash_step(hs, hs->old_size - hs->rehash_pos);
+    }
+}
+// Completes any pending incremental rehash.
+
+void hashset_set_incremental(hashset_t *hs, int on){
+    if(!on){
+        hashset_rehash_finish(hs);
+    }
+    hs->incremental = on;
+}
+// Turns incremental rehashing on (1) or off (0) for later calls to
+// hashset_expand(). Turning it off completes any pending rehash.
+// Has no effect on flat hash sets, whose expansion only rebuilds
+// their index arrays.
+
+int hashset_set_growth(hashset_t *hs, double max_load, double growth_factor, hashset_sizing_t sizing){
+    if(max_load < 0 || growth_factor <= 1.0){
+        printf("ERROR: max load must be >= 0 and growth factor > 1\n");
+        return 0;
+    }
+    hashset_rehash_finish(hs);
+    hashset_sizing_t old_sizing = hs->sizing;
+    hs->max_load = max_load;
+    hs->growth_factor = growth_factor;
+    hs->sizing = sizing;
+    if(sizing != old_sizing){
+        int size = sizing == HASHSET_SIZE_POW2 ? pow2_at_least(hs->table_size) : next_prime(hs->table_size);
+        int incremental = hs->incremental;       // old buckets can't be found under the new
+        hs->incremental = 0;                     // sizing so relayout all at once
+        hashset_resize(hs, size);
+        hs->incremental = incremental;
+    }
+    if(max_load > 0){
+        while(hs->elem_count > max_load * hs->table_size){
+            hashset_expand(hs);
+            hashset_rehash_finish(hs);
+        }
+    }
+    return 1;
+}
+// Sets the growth policy of 'hs'. With 'max_load' > 0, hashset_add()
+// expands the table whenever an add would take elem_count/table_size
+// above 'max_load'; 0 leaves expansion to explicit hashset_expand()
+// calls. Each expansion grows the table by at least 'growth_factor'
+// (> 1). 'sizing' selects prime table sizes with modulo indexing or
+// power of two sizes with mask indexing; changing it immediately
+// re-lays out the table at the nearest suitable size. If the set is
+// already over the new 'max_load' it is expanded right away. Prints
+// an error and returns 0 for invalid parameters, otherwise returns 1.
+
+int hashset_sizing_parse(char *name){
+    if(strcmp(name, "prime") == 0){
+        return HASHSET_SIZE_PRIME;
+    }
+    if(strcmp(name, "pow2") == 0){
+        return HASHSET_SIZE_POW2;
+    }
+    return -1;
+}
+// Returns the hashset_sizing_t named by 'name' ("prime" or "pow2") or
+// -1 if the name is not recognized.
+
+char *hashset_sizing_name(hashset_sizing_t sizing){
+    return sizing == HASHSET_SIZE_POW2 ? "pow2" : "prime";
+}
+// Returns the name of the given sizing as accepted by
+// hashset_sizing_parse().
+
+void hashset_set_hash(hashset_t *hs, hashfunc_t func){
+    hashset_rehash_finish(hs);
+    hs->hashfunc = func;
+    if(hs->engine == HASHSET_FLAT){
+        hashset_flat_rehash(hs);
+    } else{
+        for(hashnode_t *node = hs->order_first; node != NULL; node = node->order_next){
+            node->hash = func(HASHSET_KEY(hs, node->elem_off), node->elem_len);
+        }
+    }
+    int incremental = hs->incremental;          // old buckets can't be found under the new
+    hs->incremental = 0;                        // hash so relayout all at once
+    hashset_resize(hs, hs->table_size);
+    hs->incremental = incremental;
+    if(hs->bloom != NULL){
+        hashset_bloom_build(hs);
+    }
+}
+// Switches 'hs' to hash keys with 'func', which may be one of
+// hashset_hashfuncs[] or any function of the same type. The cached
+// hash codes of existing elems are recomputed and the elems are
+// immediately re-laid out in a table of the same size; a Bloom filter
+// is rebuilt from the new codes.
+
+void hashset_show_hashdist(hashset_t *hs){
+    int *counts = malloc(hs->table_size * sizeof(int));
+    char **keys = malloc((hs->elem_count + 1) * sizeof(char *));
+    int *lens = malloc((hs->elem_count + 1) * sizeof(int));
+    hashset_iter_t it;
+    hashset_iter_init(&it, hs, HASHSET_ITER_ORDER);
+    hashset_iter_next_many(&it, keys, lens, hs->elem_count);
+    printf("table_size: %d (%s)\n", hs->table_size, hashset_sizing_name(hs->sizing));
+    printf("%-8s %10s %10s %10s\n", "hash", "empty", "max_chain", "avg_probe");
+    for(int h = 0; h < HASHSET_HASH_COUNT; h++){
+        hashfunc_t func = hashset_hashfuncs[h].func;
+        memset(counts, 0, hs->table_size * sizeof(int));
+        for(int i = 0; i < hs->elem_count; i++){
+            counts[hashset_bucket(hs, func(keys[i], lens[i]))]++;
+        }
+        int empty = 0, max_chain = 0;
+        long probes = 0;
+        for(int b = 0; b < hs->table_size; b++){
+            empty += counts[b] == 0;
+            if(counts[b] > max_chain){
+                max_chain = counts[b];
+            }
+            probes += (long) counts[b] * (counts[b] + 1) / 2;
+        }
+        double avg = hs->elem_count == 0 ? 0.0 : (double) probes / hs->elem_count;
+        printf("%-8s %10d %10d %10.4f%s\n", hashset_hashfuncs[h].name, empty, max_chain, avg,
+               func == hs->hashfunc ? " *" : "");
+    }
+    free(keys);
+    free(lens);
+    free(counts);
+}
+// Reports how evenly each built-in hash function would spread the
+// current elems over a table of the current size and sizing, without
+// changing the set. For each function shows the number of empty
+// buckets, the longest chain and the average number of elems compared
+// by a successful search in a chained table (sum over buckets of
+// c*(c+1)/2 divided by elem_count; 1.0 is perfect). The function in
+// use is marked with '*'.
+
+void hashset_stats_bin(hashset_stats_t *stats, int len){
+    stats->chain_hist[len < HASHSET_STATS_BINS ? len : HASHSET_STATS_BINS - 1]++;
+    if(len > stats->max_chain){
+        stats->max_chain = len;
+    }
+}
+// Counts one chain of 'len' elems, or for flat sets one slot whose
+// probe is 'len' long, into the histogram of 'stats'.
+
+static long stats_chains(hashset_stats_t *stats, hashnode_t **table, int from, int to){
+    long probes = 0;
+    for(int b = from; b < to; b++){
+        int len = 0;
+        for(hashnode_t *node = table[b]; node != NULL; node = node->table_next){
+            len++;
+        }
+        hashset_stats_bin(stats, len);
+        probes += (long) len * (len + 1) / 2;
+    }
+    stats->buckets += to - from;
+    return probes;
+}
+// Adds buckets 'from' up to 'to' of 'table' to 'stats' and returns the
+// number of comparisons needed to find every elem in them once.
+
+void hashset_stats(hashset_t *hs, hashset_stats_t *stats){
+    memset(stats, 0, sizeof(hashset_stats_t));
+    stats->elem_count = hs->elem_count;
+    stats->pool_dead = hs->pool_dead;
+    if(hs->engine == HASHSET_FLAT){
+        hashset_flat_stats(hs, stats);
+    } else{
+        long probes = stats_chains(stats, hs->table, 0, hs->table_size);
+        unsigned long bytes = hs->table_size * sizeof(hashnode_t *) + hs->pool_cap;
+        if(hs->old_table != NULL){
+            probes += stats_chains(stats, hs->old_table, hs->rehash_pos, hs->old_size);
+            bytes += hs->old_size * sizeof(hashnode_t *);
+        }
+        for(hashslab_t *slab = hs->slabs; slab != NULL; slab = slab->next){
+            bytes += sizeof(hashslab_t) + slab->cap * sizeof(hashnode_t);
+        }
+        stats->heap_bytes = bytes;
+        stats->avg_probe = hs->elem_count == 0 ? 0.0 : (double) probes / hs->elem_count;
+    }
+    if(stats->buckets > 0){
+        stats->empty_fraction = (double) stats->chain_hist[0] / stats->buckets;
+    }
+    if(hs->bloom != NULL){
+        stats->bloom_bytes = (unsigned long) hs->bloom_blocks * HASHSET_BLOOM_WORDS * sizeof(unsigned long);
+        stats->bloom_checks = hs->bloom_checks;
+        if(hs->bloom_checks > 0){
+            stats->bloom_hit_ratio = (double) hs->bloom_rejects / hs->bloom_checks;
+        }
+        if(hs->bloom_rejects + hs->bloom_false > 0){
+            stats->bloom_fpr = (double) hs->bloom_false / (hs->bloom_rejects + hs->bloom_false);
+        }
+    }
+}
+// Fills in 'stats' for 'hs' in one pass over its buckets without
+// printing anything or changing the set, so it is cheap enough to
+// call periodically on a large set. Chained sets in the middle of an
+// incremental rehash also count the old buckets not yet migrated,
+// since lookups may still search them. Memory counts what the set
+// allocated, not what malloc() adds on top; nodes freed by removals
+// stay counted as they remain in their slabs for reuse. A Bloom filter
+// is reported separately along with its record since it was attached:
+// the share of lookups it answered alone and, of the lookups for absent
+// keys, the share it let through to a search that found nothing.
+
+void hashset_show_stats(hashset_t *hs){
+    hashset_stats_t stats;
+    hashset_stats(hs, &stats);
+    printf("elem_count: %d\n", stats.elem_count);
+    printf("buckets: %d\n", stats.buckets);
+    printf("empty: %d (%.4f)\n", stats.chain_hist[0], stats.empty_fraction);
+    printf("max_chain: %d\n", stats.max_chain);
+    printf("avg_probe: %.4f\n", stats.avg_probe);
+    printf("chain_hist:");
+    for(int i = 0; i < HASHSET_STATS_BINS; i++){
+        if(stats.chain_hist[i] > 0){
+            printf(" %d%s:%d", i, i == HASHSET_STATS_BINS - 1 ? "+" : "", stats.chain_hist[i]);
+        }
+    }
+    printf("\n");
+    printf("heap_bytes: %lu\n", stats.heap_bytes);
+    printf("mapped_bytes: %lu\n", stats.mapped_bytes);
+    printf("pool_dead: %lu\n", stats.pool_dead);
+    if(stats.bloom_bytes > 0){
+        printf("bloom_bytes: %lu\n", stats.bloom_bytes);
+        printf("bloom_checks: %lu\n", stats.bloom_checks);
+        printf("bloom_hit_ratio: %.4f\n", stats.bloom_hit_ratio);
+        printf("bloom_fpr: %.4f\n", stats.bloom_fpr);
+    }
+}
+// Prints the summary from hashset_stats() instead of every node as
+// hashset_show_structure() does. The histogram lists only non-empty
+// bins as length:count; for flat sets length is the elem's probe
+// length and bin 0 counts empty slots. The bloom_ lines only appear
+// for a set with a Bloom filter.
@@ -0,0 +1,171 @@
+#include "hashset.h"
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+// hashset_hash.c: hash functions that can be plugged into a hash set
+// with hashset_set_hash(). All take a key and its length and return
+// an int hash code which hashset_bucket() reduces to a table index.
+// Only the "java" function reproduces hashcode(); the others read the
+// key a whole word at a time.
+
+#define WY_P0 0xa0761d6478bd642fUL        // wyhash mixing constants
+#define WY_P1 0xe7037ed1a0b428dbUL
+#define WY_P2 0x8ebc6af09c88c6e3UL
+#define CRC32C_POLY 0x82F63B78u           // Castagnoli polynomial, bit-reversed
+
+static int hash_java(char key[], int len){
+    return hashcode(key);
+}
+// The original hashcode(): hc*31 + c for each byte, as Java's
+// String.hashCode(). Kept as the default so existing tables lay out
+// exactly as before.
+
+static unsigned long read_word(char *p){
+    unsigned long w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+// Reads 8 bytes from an arbitrarily aligned position; compiles to a
+// single load on machines that allow unaligned access.
+
+static unsigned long read_tail(char *p, int len){
+    unsigned long w = 0;
+    memcpy(&w, p, len);
+    return w;
+}
+// Reads the last 0 to 7 bytes of a key into the low bytes of a word.
+
+static unsigned long wymix(unsigned long a, unsigned long b){
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 r = (unsigned __int128) a * b;
+    return (unsigned long) r ^ (unsigned long) (r >> 64);
+#else
+    unsigned long r = a * (b | 1);
+    return r ^ (r >> 32) ^ b;
+#endif
+}
+// Multiplies two words to 128 bits and folds the halves together,
+// the core mixing step of wyhash.
+
+static int hash_wyhash(char key[], int len){
+    unsigned long seed = WY_P0 ^ (unsigned long) len;
+    char *p = key;
+    int left = len;
+    while(left > 16){
+        seed = wymix(read_word(p) ^ WY_P1, read_word(p + 8) ^ seed);
+        p += 16;
+        left -= 16;
+    }
+    unsigned long a, b;
+    if(left > 8){
+        a = read_word(p);
+        b = read_word(p + left - 8);
+    } else{
+        a = read_tail(p, left);
+        b = 0;
+    }
+    unsigned long h = wymix(a ^ WY_P1, b ^ seed);
+    h = wymix(h ^ WY_P2, (unsigned long) len ^ WY_P1);
+    return (int) (h ^ (h >> 32));
+}
+// Word-at-a-time hash in the style of wyhash: consumes 16 bytes per
+// round with one 64x64->128 bit multiply, then finishes with the last
+// (possibly overlapping) 16 bytes and the length. Every input bit
+// affects every output bit, so both the low bits used by power of two
+// tables and the high bits used for flat control bytes are good.
+
+static unsigned int crc32c_table[256];
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+static void crc32c_table_build(){
+    for(unsigned int i = 0; i < 256; i++){
+        unsigned int c = i;
+        for(int k = 0; k < 8; k++){
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        crc32c_table[i] = c;
+    }
+}
+// Builds the byte-at-a-time lookup table for the software CRC32C. Run
+// exactly once through 'crc32c_once', as the first hashes may come from
+// several threads at the same time.
+
+static unsigned int crc32c_soft(char *p, int len){
+    pthread_once(&crc32c_once, crc32c_table_build);
+    unsigned int crc = 0xFFFFFFFFu;
+    for(int i = 0; i < len; i++){
+        crc = crc32c_table[(crc ^ (unsigned char) p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+// Table driven CRC32C used where the CPU lacks the crc32 instruction.
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("sse4.2")))
+static unsigned int crc32c_hw(char *p, int len){
+    unsigned long crc = 0xFFFFFFFFu;
+    while(len >= 8){
+        crc = __builtin_ia32_crc32di(crc, read_word(p));
+        p += 8;
+        len -= 8;
+    }
+    unsigned int crc32 = crc;
+    while(len > 0){
+        crc32 = __builtin_ia32_crc32qi(crc32, *p);
+        p++;
+        len--;
+    }
+    return crc32;
+}
+// CRC32C using the SSE4.2 crc32 instruction, 8 bytes per step.
+#endif
+
+static int hash_crc32c(char key[], int len){
+    unsigned int crc;
+#if defined(__x86_64__) && defined(__GNUC__)
+    if(__builtin_cpu_supports("sse4.2")){
+        crc = crc32c_hw(key, len);
+    } else{
+        crc = crc32c_soft(key, len);
+    }
+#else
+    crc = crc32c_soft(key, len);
+#endif
+    crc = ~crc;
+    return (int) (crc ^ (crc >> 16) ^ (crc << 13));
+}
+// CRC32C of the key computed with the hardware instruction when the
+// CPU has it and a lookup table otherwise; both give the same value
+// so tables built on one machine hash the same on another. The final
+// xor-shift spreads the CRC's low bits, which would otherwise depend
+// only on the last few bytes, into the bits a power of two table uses.
+
+hashset_hashdef_t hashset_hashfuncs[HASHSET_HASH_COUNT] = {
+    {"java",   hash_java},
+    {"wyhash", hash_wyhash},
+    {"crc32c", hash_crc32c},
+};
+// Built-in hash functions selectable by name; the first is the
+// default for new hash sets.
+
+hashfunc_t hashset_hash_parse(char *name){
+    for(int i = 0; i < HASHSET_HASH_COUNT; i++){
+        if(strcmp(name, hashset_hashfuncs[i].name) == 0){
+            return hashset_hashfuncs[i].func;
+        }
+    }
+    return NULL;
+}
+// Returns the built-in hash function named 'name' or NULL if there is
+// no such function.
+
+char *hashset_hash_name(hashfunc_t func){
+    for(int i = 0; i < HASHSET_HASH_COUNT; i++){
+        if(hashset_hashfuncs[i].func == func){
+            return hashset_hashfuncs[i].name;
+        }
+    }
+    return "custom";
+}
+// Returns the name of a built-in hash function or "custom" for one
+// supplied by the caller.
@@ -0,0 +1,110 @@
+#include "hashset.h"
+// hashset_iter.c: cursors over the elems of a hash set. A cursor is a
+// small struct the caller owns, typically on the stack, so iterating
+// allocates nothing and never goes through stdio. Elems come back as
+// pointers to their keys in the set's key pool, with the length and
+// cached hash code of the last one kept in the cursor, so a consumer
+// such as a set operation can reuse them without calling strlen() or
+// the hash function again.
+//
+// Any change to the set invalidates its cursors. For a chained set in
+// the middle of an incremental rehash that includes
+// hashset_contains(), which migrates buckets.
+
+void hashset_iter_init(hashset_iter_t *it, hashset_t *hs, hashset_iter_kind_t kind){
+    it->hs = hs;
+    it->kind = kind;
+    it->node = NULL;
+    it->pos = 0;
+    it->old = 0;
+    it->len = 0;
+    it->hash = 0;
+    if(hs->engine == HASHSET_CHAINED && kind == HASHSET_ITER_ORDER){
+        it->node = hs->order_first;
+    }
+}
+// Positions 'it' before the first elem of 'hs' in the given order.
+
+static hashnode_t *iter_next_bucket_node(hashset_iter_t *it){
+    hashset_t *hs = it->hs;
+    while(it->node == NULL){
+        hashnode_t **table = it->old ? hs->old_table : hs->table;
+        int size = it->old ? hs->old_size : hs->table_size;
+        if(it->pos == size){
+            if(it->old || hs->old_table == NULL){
+                return NULL;
+            }
+            it->old = 1;
+            it->pos = hs->rehash_pos;
+            continue;
+        }
+        it->node = table[it->pos++];
+    }
+    return it->node;
+}
+// Skips empty buckets to the next node of a chained set in table
+// order. While an incremental rehash is pending, the buckets of the
+// old table that have not been migrated follow those of the new one,
+// so every elem is still visited exactly once.
+
+char *hashset_iter_next(hashset_iter_t *it){
+    hashset_t *hs = it->hs;
+    if(hs->engine == HASHSET_FLAT){
+        hashentry_t *entry;
+        if(it->kind == HASHSET_ITER_ORDER){
+            while(it->pos < hs->entry_len && hs->entries[it->pos].len == HASHSET_ENTRY_DEAD){
+                it->pos++;
+            }
+            if(it->pos == hs->entry_len){
+                return NULL;
+            }
+            entry = &hs->entries[it->pos++];
+        } else{
+            while(it->pos < hs->table_size && hs->ctrl[it->pos] == HASHSET_CTRL_EMPTY){
+                it->pos++;
+            }
+            if(it->pos == hs->table_size){
+                return NULL;
+            }
+            entry = &hs->entries[hs->slots[it->pos++]];
+        }
+        it->len = entry->len;
+        it->hash = entry->hash;
+        return HASHSET_KEY(hs, entry->off);
+    }
+    hashnode_t *node = it->kind == HASHSET_ITER_ORDER ? it->node : iter_next_bucket_node(it);
+    if(node == NULL){
+        return NULL;
+    }
+    it->node = it->kind == HASHSET_ITER_ORDER ? node->order_next : node->table_next;
+    it->len = node->elem_len;
+    it->hash = node->hash;
+    return HASHSET_KEY(hs, node->elem_off);
+}
+// Returns the next elem of the cursor's set, or NULL once every elem
+// has been returned, and records its length and hash code in 'it'.
+// Insertion order follows the order list of a chained set or the live
+// entries of a flat one. Table order walks each bucket list front to
+// back, or the occupied slots of a flat set, which is the order
+// hashset_show_structure() shows elems in. The string returned lives
+// in the set and must not be changed or free()'d.
+
+int hashset_iter_next_many(hashset_iter_t *it, char *keys[], int lens[], int n){
+    int count = 0;
+    while(count < n){
+        char *key = hashset_iter_next(it);
+        if(key == NULL){
+            break;
+        }
+        keys[count] = key;
+        if(lens != NULL){
+            lens[count] = it->len;
+        }
+        count++;
+    }
+    return count;
+}
+// Fills keys[0..] with up to 'n' further elems, and lens[] with their
+// lengths unless 'lens' is NULL, and returns how many were filled; 0
+// means the cursor is exhausted. Lets a consumer work through a set
+// in fixed size batches, e.g. to hand them to hashset_add_many().
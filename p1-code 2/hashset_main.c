@@ -1,41 +1,177 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "hashset.h"
 
+#define INPUT_BLOCK  (1 << 20)          // bytes read at a time in batch mode
+#define OUTPUT_BLOCK (1 << 20)          // bytes of output buffered in batch mode
+
+// Source of whitespace separated tokens for the command loop
+typedef struct {
+  FILE *fp;                             // input stream
+  int batch;                            // 1: read in blocks, 0: read one token at a time with getc()
+  char *buf;                            // block of input, or the last token read with getc()
+  long cap;                             // allocated length of 'buf' less 1 for a final '\0'
+  long len;                             // bytes of input in 'buf'
+  long pos;                             // next unread byte of 'buf'
+  int eof;                              // 1 once the stream has no more input beyond 'buf'
+} input_t;
+
+static int is_space(char c){
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Returns the next token of input or NULL at the end of input. In
+// batch mode tokens are '\0' terminated in place in the input block,
+// so nothing is copied; a token that runs off the end of the block is
+// moved to the front and the rest of the block is filled with one
+// fread(). Interactively, characters are read one at a time so that
+// no input past the token is waited for, and 'buf' is doubled for
+// long tokens just like the block. Either way there is no limit on the
+// length of a token. The returned string is only valid until the next
+// call.
+static char *next_token(input_t *in){
+  if(!in->batch){
+    int c = getc(in->fp);
+    while(c != EOF && is_space(c)){
+      c = getc(in->fp);
+    }
+    if(c == EOF){
+      return NULL;
+    }
+    long len = 0;
+    for(; c != EOF && !is_space(c); c = getc(in->fp)){
+      if(len == in->cap){
+        in->cap *= 2;
+        in->buf = realloc(in->buf, in->cap + 1);
+      }
+      in->buf[len++] = c;
+    }
+    in->buf[len] = '\0';
+    return in->buf;
+  }
+  while(1){
+    while(in->pos < in->len && is_space(in->buf[in->pos])){
+      in->pos++;
+    }
+    long end = in->pos;
+    while(end < in->len && !is_space(in->buf[end])){
+      end++;
+    }
+    if(end < in->len || (in->eof && end > in->pos)){
+      char *tok = &in->buf[in->pos];
+      in->buf[end] = '\0';
+      in->pos = end + 1;
+      return tok;
+    }
+    if(in->eof){
+      return NULL;
+    }
+    in->len -= in->pos;
+    memmove(in->buf, &in->buf[in->pos], in->len);
+    in->pos = 0;
+    if(in->len == in->cap){                 // a single token longer than the block
+      in->cap *= 2;
+      in->buf = realloc(in->buf, in->cap + 1);
+    }
+    long got = fread(&in->buf[in->len], 1, in->cap - in->len, in->fp);
+    if(got == 0){
+      in->eof = 1;
+    }
+    in->len += got;
+  }
+}
+
+// Returns the next token as the argument of a command, or "" if the
+// input ends first.
+static char *next_arg(input_t *in){
+  char *tok = next_token(in);
+  return tok == NULL ? "" : tok;
+}
+
 int main(int argc, char *argv[]){
   int echo = 0;                                // controls echoing, 0: echo off, 1: echo on
+  int batch = 0;                               // batch mode: no help/prompts, block I/O
+  FILE *script = stdin;
   if(argc > 1 && strcmp("-echo",argv[1])==0) { // turn echoing on via -echo command line option
     echo=1;
   }
+  if(argc > 1 && strcmp("-batch",argv[1])==0) { // batch mode via -batch [script]
+    batch=1;
+    if(argc > 2){
+      script = fopen(argv[2], "r");
+      if(script == NULL){
+        printf("ERROR: could not open file '%s'\n", argv[2]);
+        return 1;
+      }
+    }
+  }
+
+  input_t in = {.fp = script, .batch = batch};
+  in.cap = batch ? INPUT_BLOCK : HASHSET_KEY_MAX;
+  in.buf = malloc(in.cap + 1);
+  char *outbuf = NULL;
+  if(batch){
+    outbuf = malloc(OUTPUT_BLOCK);
+    setvbuf(stdout, outbuf, _IOFBF, OUTPUT_BLOCK);
+  }
+  struct timespec start, stop;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  long commands = 0;
 
-  printf("Hashset Application\n");
-  printf("Commands:\n");
-  printf("  hashcode <elem>  : prints out the numeric hash code for the given key (does not change the hash set)\n");
-  printf("  contains <elem>  : prints the value associated with the given element or NOT PRESENT\n");
-  printf("  add <elem>       : inserts the given element into the hash set, reports existing element\n");
-  printf("  print            : prints all elements in the hash set in the order they were addded\n");
-  printf("  structure        : prints detailed structure of the hash set\n");
-  printf("  clear            : reinitializes hash set to be empty with default size\n");
-  printf("  save <file>      : writes the contents of the hash set to the given file\n");
-  printf("  load <file>      : clears the current hash set and loads the one in the given file\n");
-  printf("  next_prime <int> : if <int> is prime, prints it, otherwise finds the next prime and prints it\n");
-  printf("  expand           : expands memory size of hash set to reduce its load factor\n");
-  printf("  quit             : exit the program\n");
+  if(!batch){
+    printf("Hashset Application\n");
+    printf("Commands:\n");
+    printf("  hashcode <elem>  : prints out the numeric hash code for the given key (does not change the hash set)\n");
+    printf("  contains <elem>  : prints the value associated with the given element or NOT PRESENT\n");
+    printf("  add <elem>       : inserts the given element into the hash set, reports existing element\n");
+    printf("  remove <elem>    : removes the given element from the hash set, reports missing element\n");
+    printf("  addfile <file>   : adds every whitespace separated key in the given file as one batch, reports count added\n");
+    printf("  containsfile <file> : looks up every key in the given file as one batch, reports count found\n");
+    printf("  print            : prints all elements in the hash set in the order they were addded\n");
+    printf("  printbuckets     : prints all elements in table order, bucket by bucket\n");
+    printf("  structure        : prints detailed structure of the hash set\n");
+    printf("  stats            : prints chain length histogram, empty buckets, average probe and memory use\n");
+    printf("  clear            : reinitializes hash set to be empty with default size\n");
+    printf("  save <file>      : writes the contents of the hash set to the given file\n");
+    printf("  load <file>      : clears the current hash set and loads the one in the given file\n");
+    printf("  pload <n> <file> : like load but parses, hashes and places elems with n threads, 0 for one per core\n");
+    printf("  union <file>     : replaces the set with its union with the set saved in the given file\n");
+    printf("  intersect <file> : replaces the set with the elems it shares with the set saved in the given file\n");
+    printf("  difference <file>: removes the elems of the set saved in the given file, keeping insertion order\n");
+    printf("  threads <n>      : sets the threads union/intersect/difference look elems up with, 0 for one per core\n");
+    printf("  snapshot <file>  : writes the hash set to the given file as a binary snapshot that load maps in place\n");
+    printf("  next_prime <int> : if <int> is prime, prints it, otherwise finds the next prime and prints it\n");
+    printf("  expand           : expands memory size of hash set to reduce its load factor\n");
+    printf("  engine <name>    : clears the hash set and reinitializes it with engine 'chained' or 'flat'\n");
+    printf("  bloom <0|1>      : removes/attaches a Bloom filter that rules out most absent keys before a search\n");
+    printf("  incremental <0|1>: turns off/on spreading expand's rehash over later add/contains commands\n");
+    printf("  growth <load> <factor> <prime|pow2> : expand on add above max load (0 for never) by factor\n");
+    printf("  hashfunc <name>  : rehashes the set with hash function 'java', 'wyhash' or 'crc32c'\n");
+    printf("  hashdist         : reports the bucket distribution each hash function gives the current set\n");
+    printf("  quit             : exit the program\n");
+  }
   
-  char cmd[128];
+  char *cmd;
+  int setop_threads = 1;                       // threads for union/intersect/difference, see 'threads'
   hashset_t hash;
-  int success;
   hashset_init(&hash, HASHSET_DEFAULT_TABLE_SIZE);
 
   while(1){
-    printf("HS>> ");                 // print prompt
-    success = fscanf(stdin,"%s",cmd); // read a command
-    if(success==EOF){                 // check for end of input
-      printf("\n");                   // found end of input
+    if(!batch){
+      printf("HS>> ");               // print prompt
+    }
+    cmd = next_token(&in);            // read a command
+    if(cmd == NULL){                  // check for end of input
+      if(!batch){
+        printf("\n");                 // found end of input
+      }
       break;                          // break from loop
     }
+    commands++;
 
     if( strcmp("quit", cmd)==0 ){     // check for exit command
       if(echo){
@@ -45,11 +181,11 @@ int main(int argc, char *argv[]){
     }
 
     else if( strcmp("hashcode", cmd) == 0){     
-      fscanf(stdin,"%s", cmd);
+      cmd = next_arg(&in);
       if(echo){
         printf("hashcode %s\n", cmd);
       }
-      printf("%d\n", hashcode(cmd));
+      printf("%d\n", hashset_hash(&hash, cmd));
     }
 
     else if( strcmp("structure", cmd) == 0){     
@@ -59,8 +195,15 @@ int main(int argc, char *argv[]){
       hashset_show_structure(&hash);
     }
 
+    else if( strcmp("stats", cmd) == 0){
+      if(echo){
+        printf("stats\n");
+      }
+      hashset_show_stats(&hash);
+    }
+
     else if( strcmp("contains", cmd) == 0){
-      fscanf(stdin,"%s", cmd);
+      cmd = next_arg(&in);
       if(echo){
         printf("contains %s\n", cmd);
       }
@@ -72,13 +215,37 @@ int main(int argc, char *argv[]){
     }
 
     else if( strcmp("add", cmd) == 0){
-      fscanf(stdin, "%s", cmd);
+      cmd = next_arg(&in);
       if(echo){
         printf("add %s\n", cmd);
       }
       hashset_add(&hash, cmd);
     }
 
+    else if( strcmp("remove", cmd) == 0){
+      cmd = next_arg(&in);
+      if(echo){
+        printf("remove %s\n", cmd);
+      }
+      hashset_remove(&hash, cmd);
+    }
+
+    else if( strcmp("addfile", cmd) == 0){
+      cmd = next_arg(&in);
+      if(echo){
+        printf("addfile %s\n", cmd);
+      }
+      hashset_batch_file(&hash, cmd, 1);
+    }
+
+    else if( strcmp("containsfile", cmd) == 0){
+      cmd = next_arg(&in);
+      if(echo){
+        printf("containsfile %s\n", cmd);
+      }
+      hashset_batch_file(&hash, cmd, 0);
+    }
+
     else if( strcmp("expand", cmd) == 0){
       if(echo){
         printf("expand\n");
@@ -86,9 +253,59 @@ int main(int argc, char *argv[]){
       hashset_expand(&hash);
     }
 
+    else if( strcmp("incremental", cmd) == 0){
+      int on = atoi(next_arg(&in));
+      if(echo){
+        printf("incremental %d\n", on);
+      }
+      hashset_set_incremental(&hash, on);
+    }
+
+    else if( strcmp("bloom", cmd) == 0){
+      int on = atoi(next_arg(&in));
+      if(echo){
+        printf("bloom %d\n", on);
+      }
+      hashset_set_bloom(&hash, on);
+    }
+
+    else if( strcmp("growth", cmd) == 0){
+      double max_load = atof(next_arg(&in));
+      double factor = atof(next_arg(&in));
+      cmd = next_arg(&in);
+      if(echo){
+        printf("growth %g %g %s\n", max_load, factor, cmd);
+      }
+      int sizing = hashset_sizing_parse(cmd);
+      if(sizing == -1){
+        printf("unknown sizing %s\n", cmd);
+      } else{
+        hashset_set_growth(&hash, max_load, factor, sizing);
+      }
+    }
+
+    else if( strcmp("hashfunc", cmd) == 0){
+      cmd = next_arg(&in);
+      if(echo){
+        printf("hashfunc %s\n", cmd);
+      }
+      hashfunc_t func = hashset_hash_parse(cmd);
+      if(func == NULL){
+        printf("unknown hash function %s\n", cmd);
+      } else{
+        hashset_set_hash(&hash, func);
+      }
+    }
+
+    else if( strcmp("hashdist", cmd) == 0){
+      if(echo){
+        printf("hashdist\n");
+      }
+      hashset_show_hashdist(&hash);
+    }
+
     else if( strcmp("next_prime", cmd) == 0){
-      int num;
-      fscanf(stdin, "%d", &num);
+      int num = atoi(next_arg(&in));
       if(echo){
         printf("next_prime %d\n", num);
       }
@@ -96,27 +313,89 @@ int main(int argc, char *argv[]){
     }
 
     else if( strcmp("load", cmd) == 0){
-      fscanf(stdin, "%s", cmd);
+      cmd = next_arg(&in);
       if(echo){
         printf("load %s\n", cmd);
       }
       hashset_load(&hash, cmd);
     }
 
+    else if( strcmp("pload", cmd) == 0){
+      int nthreads = atoi(next_arg(&in));
+      cmd = next_arg(&in);
+      if(echo){
+        printf("pload %d %s\n", nthreads, cmd);
+      }
+      hashset_load_parallel(&hash, &cmd, 1, nthreads);
+    }
+
+    else if( strcmp("union", cmd) == 0 || strcmp("intersect", cmd) == 0 ||
+             strcmp("difference", cmd) == 0){
+      char op[16];                    // next_arg() reuses the token buffer
+      strcpy(op, cmd);
+      cmd = next_arg(&in);
+      if(echo){
+        printf("%s %s\n", op, cmd);
+      }
+      hashset_t other, result;
+      hashset_init_engine(&other, HASHSET_DEFAULT_TABLE_SIZE, hash.engine);
+      if(hashset_load(&other, cmd)){
+        if(op[0] == 'u'){
+          hashset_union(&result, &hash, &other, setop_threads);
+        } else if(op[0] == 'i'){
+          hashset_intersect(&result, &hash, &other, setop_threads);
+        } else{
+          hashset_difference(&result, &hash, &other, setop_threads);
+        }
+        hashset_free_fields(&hash);
+        hash = result;
+        printf("%s has %d elems\n", op, hash.elem_count);
+      }
+      hashset_free_fields(&other);
+    }
+
+    else if( strcmp("threads", cmd) == 0){
+      setop_threads = atoi(next_arg(&in));
+      if(echo){
+        printf("threads %d\n", setop_threads);
+      }
+    }
+
     else if( strcmp("save", cmd) == 0){
-      fscanf(stdin, "%s", cmd);
+      cmd = next_arg(&in);
       if(echo){
         printf("save %s\n", cmd);
       }
       hashset_save(&hash, cmd);
     }
 
+    else if( strcmp("snapshot", cmd) == 0){
+      cmd = next_arg(&in);
+      if(echo){
+        printf("snapshot %s\n", cmd);
+      }
+      hashset_save_snapshot(&hash, cmd);
+    }
+
     else if( strcmp("clear", cmd)==0 ){   // clear command
       if(echo){
         printf("clear\n");
       }
-      hashset_free_fields(&hash);
-      hashset_init(&hash, HASHSET_DEFAULT_TABLE_SIZE);
+      hashset_reset(&hash, HASHSET_DEFAULT_TABLE_SIZE);
+    }
+
+    else if( strcmp("engine", cmd)==0 ){  // engine command
+      cmd = next_arg(&in);
+      if(echo){
+        printf("engine %s\n", cmd);
+      }
+      int engine = hashset_engine_parse(cmd);
+      if(engine == -1){
+        printf("unknown engine %s\n", cmd);
+      } else{
+        hashset_free_fields(&hash);
+        hashset_init_engine(&hash, HASHSET_DEFAULT_TABLE_SIZE, engine);
+      }
     }
 
     else if( strcmp("print", cmd)==0 ){   // print command
@@ -126,6 +405,22 @@ int main(int argc, char *argv[]){
       hashset_write_elems_ordered(&hash, stdout);
     }
 
+    else if( strcmp("printbuckets", cmd)==0 ){
+      if(echo){
+        printf("printbuckets\n");
+      }
+      hashset_iter_t it;
+      hashset_iter_init(&it, &hash, HASHSET_ITER_BUCKET);
+      char *keys[HASHSET_BATCH];
+      int n, count = 1;
+      while((n = hashset_iter_next_many(&it, keys, NULL, HASHSET_BATCH)) > 0){
+        for(int i = 0; i < n; i++){
+          printf("   %d %s\n", count, keys[i]);
+          count++;
+        }
+      }
+    }
+
     else{                                 // unknown command
       if(echo){
         printf("%s\n",cmd);
@@ -135,5 +430,18 @@ int main(int argc, char *argv[]){
   }  
                                                                       // clean up the list
   hashset_free_fields(&hash);
+  if(batch){
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    double secs = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+    fflush(stdout);
+    fprintf(stderr, "batch: %ld commands in %.3f sec, %.0f commands/sec\n",
+            commands, secs, secs > 0 ? commands / secs : 0.0);
+    if(script != stdin){
+      fclose(script);
+    }
+  }
+  free(in.buf);
+  fclose(stdout);
+  free(outbuf);
   return 0;
 }
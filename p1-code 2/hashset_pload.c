@@ -0,0 +1,470 @@
+#include "hashset.h"
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+// hashset_pload.c: multi-threaded loading of files written by
+// hashset_save(). The files are mapped and each is cut into one chunk
+// of whole lines per thread. Loading then runs in three parallel
+// passes with short sequential steps between them:
+//
+// 1. count : each thread counts the keys and key bytes in its chunks
+// 2. copy  : with every chunk's first elem index and key pool offset
+//            known from the counts, threads copy their keys into the
+//            pool, hash them and fill in entries or nodes directly at
+//            their final index, so insertion order is the file order;
+//            each key is also filed under the table range ("region")
+//            its home bucket falls in
+// 3. place : thread r links every elem whose home is in region r into
+//            the table, in file order, so no two threads ever write
+//            the same bucket or slot
+//
+// Flat probes that would run past the end of their region are left to
+// a sequential pass at the end, as are repeated keys, which are
+// detected while placing and dropped as hashset_load() drops them,
+// though without printing a message for each.
+
+typedef struct {
+    char *start;                // first byte of the chunk, the start of a line
+    char *end;                  // one past its last byte
+    long keys;                  // keys loaded from the chunk
+    unsigned long bytes;        // pool bytes those keys take, '\0's included
+    long first;                 // elem index of the chunk's first key
+    unsigned long pool_off;     // pool offset of the chunk's first key
+    long *region_pos;           // per region: keys found, then next index in 'order'
+} pload_chunk_t;
+
+typedef struct {
+    hashset_t *hs;              // set being loaded
+    int nthreads;               // threads, and regions the table is split into
+    pload_chunk_t *chunks;      // chunk c is handled by thread c % nthreads
+    int nchunks;
+    int *bounds;                // region r is buckets bounds[r] up to bounds[r+1]
+    long *region_start;         // region r's elems are order[region_start[r]..region_start[r+1]]
+    int *order;                 // elem indices grouped by region, file order within each
+    hashnode_t *nodes;          // CHAINED: node of every elem, by index
+    char *dups;                 // 1 for each elem whose key was already loaded
+    int **spills;               // FLAT: per region, elems whose probe left the region
+    int *spill_len;
+    long *dup_count;            // per thread, elems marked in 'dups'
+} pload_job_t;
+
+typedef struct {
+    pload_job_t *job;
+    int id;
+} pload_worker_t;
+
+static char *pload_next_key(char *p, char *end, char **key, int *len){
+    for(int field = 0; field < 2; field++){
+        while(p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')){
+            p++;
+        }
+        if(p == end){
+            return NULL;
+        }
+        *key = p;
+        while(p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r'){
+            p++;
+        }
+    }
+    *len = p - *key;
+    return p;
+}
+// Parses one "<index> <elem>" line of a save file starting at 'p',
+// setting 'key' and 'len' to the elem, and returns the position after
+// it, or NULL if the text before 'end' holds no further elem. Like the
+// scanf() in hashset_load() it splits on whitespace, not lines.
+
+static void pload_scan(pload_chunk_t *chunk, long limit){
+    char *p = chunk->start;
+    char *key;
+    int len;
+    chunk->keys = 0;
+    chunk->bytes = 0;
+    while(chunk->keys < limit && (p = pload_next_key(p, chunk->end, &key, &len)) != NULL){
+        chunk->keys++;
+        chunk->bytes += len + 1;
+    }
+}
+// Counts the keys of 'chunk', at most 'limit' of them, and the pool
+// bytes they need.
+
+static int pload_region(pload_job_t *job, int bucket){
+    return (long) bucket * job->nthreads / job->hs->table_size;
+}
+// Region of the table that 'bucket' belongs to.
+
+static void *pload_count_thread(void *arg){
+    pload_worker_t *w = arg;
+    for(int c = w->id; c < w->job->nchunks; c += w->job->nthreads){
+        pload_scan(&w->job->chunks[c], LONG_MAX);
+    }
+    return NULL;
+}
+
+static void *pload_copy_thread(void *arg){
+    pload_worker_t *w = arg;
+    pload_job_t *job = w->job;
+    hashset_t *hs = job->hs;
+    for(int c = w->id; c < job->nchunks; c += job->nthreads){
+        pload_chunk_t *chunk = &job->chunks[c];
+        char *p = chunk->start;
+        unsigned long off = chunk->pool_off;
+        for(long i = chunk->first; i < chunk->first + chunk->keys; i++){
+            char *key;
+            int len;
+            p = pload_next_key(p, chunk->end, &key, &len);
+            char *copy = HASHSET_KEY(hs, off);
+            memcpy(copy, key, len);
+            copy[len] = '\0';
+            int hash = hs->hashfunc(copy, len);
+            if(hs->engine == HASHSET_FLAT){
+                hs->entries[i] = (hashentry_t) {.hash = hash, .len = len, .off = off};
+            } else{
+                hashnode_t *node = &job->nodes[i];
+                node->elem_off = off;
+                node->elem_len = len;
+                node->hash = hash;
+                node->order_prev = i > 0 ? node - 1 : NULL;
+                node->order_next = i + 1 < hs->elem_count ? node + 1 : NULL;
+            }
+            chunk->region_pos[pload_region(job, hashset_bucket(hs, hash))]++;
+            off += len + 1;
+        }
+    }
+    return NULL;
+}
+
+static int pload_hash_of(pload_job_t *job, long i){
+    if(job->hs->engine == HASHSET_FLAT){
+        return job->hs->entries[i].hash;
+    }
+    return job->nodes[i].hash;
+}
+
+static void *pload_group_thread(void *arg){
+    pload_worker_t *w = arg;
+    pload_job_t *job = w->job;
+    for(int c = w->id; c < job->nchunks; c += job->nthreads){
+        pload_chunk_t *chunk = &job->chunks[c];
+        for(long i = chunk->first; i < chunk->first + chunk->keys; i++){
+            int r = pload_region(job, hashset_bucket(job->hs, pload_hash_of(job, i)));
+            job->order[chunk->region_pos[r]++] = i;
+        }
+    }
+    return NULL;
+}
+
+static void *pload_place_thread(void *arg){
+    pload_worker_t *w = arg;
+    pload_job_t *job = w->job;
+    hashset_t *hs = job->hs;
+    int r = w->id;
+    int spill_cap = 0;
+    for(long k = job->region_start[r]; k < job->region_start[r + 1]; k++){
+        int e = job->order[k];
+        if(hs->engine == HASHSET_FLAT){
+            int placed = hashset_flat_claim(hs, e, job->bounds[r + 1]);
+            if(placed == -1){
+                if(job->spill_len[r] == spill_cap){
+                    spill_cap = spill_cap == 0 ? 16 : 2 * spill_cap;
+                    job->spills[r] = realloc(job->spills[r], spill_cap * sizeof(int));
+                }
+                job->spills[r][job->spill_len[r]++] = e;
+            } else if(placed == 0){
+                job->dups[e] = 1;
+                job->dup_count[r]++;
+            }
+            continue;
+        }
+        hashnode_t *node = &job->nodes[e];
+        int index = hashset_bucket(hs, node->hash);
+        hashnode_t *other = hs->table[index];
+        while(other != NULL && !(other->hash == node->hash && other->elem_len == node->elem_len &&
+                                 memcmp(HASHSET_KEY(hs, other->elem_off), HASHSET_KEY(hs, node->elem_off),
+                                        node->elem_len) == 0)){
+            other = other->table_next;
+        }
+        if(other != NULL){
+            job->dups[e] = 1;
+            job->dup_count[r]++;
+            continue;
+        }
+        node->table_next = hs->table[index];
+        hs->table[index] = node;
+    }
+    return NULL;
+}
+// Pass 3 for region r. Elems arrive in file order, so a chained bucket
+// ends up as it would after adding them one by one, and the first
+// copy of a repeated key is the one kept.
+
+static void pload_run(pload_job_t *job, void *(*func)(void *)){
+    pthread_t *threads = malloc(job->nthreads * sizeof(pthread_t));
+    pload_worker_t *workers = malloc(job->nthreads * sizeof(pload_worker_t));
+    int *started = calloc(job->nthreads, sizeof(int));
+    for(int t = 0; t < job->nthreads; t++){
+        workers[t] = (pload_worker_t) {.job = job, .id = t};
+        started[t] = pthread_create(&threads[t], NULL, func, &workers[t]) == 0;
+    }
+    for(int t = 0; t < job->nthreads; t++){
+        if(started[t]){
+            pthread_join(threads[t], NULL);
+        } else{
+            func(&workers[t]);
+        }
+    }
+    free(threads);
+    free(workers);
+    free(started);
+}
+// Runs one pass: 'func' on every thread of 'job', waiting for all.
+// Workers of a pass never wait on each other, so the share of a
+// thread that could not be started is run on the calling thread
+// instead, giving the same result with less parallelism; if no thread
+// starts the pass is simply single-threaded.
+
+static long pload_int(char **p, char *end){
+    long num = 0;
+    while(*p < end && (**p == ' ' || **p == '\t')){
+        (*p)++;
+    }
+    while(*p < end && **p >= '0' && **p <= '9'){
+        num = 10 * num + (**p - '0');
+        (*p)++;
+    }
+    return num;
+}
+// Reads a non-negative decimal number at '*p' and advances past it.
+// Mapped files are not '\0' terminated so strtol() cannot be used.
+
+static void pload_drop(pload_job_t *job, long e){
+    hashset_t *hs = job->hs;
+    if(hs->engine == HASHSET_FLAT){
+        hs->pool_dead += hs->entries[e].len + 1;
+        hs->entries[e].len = HASHSET_ENTRY_DEAD;
+    } else{
+        hashnode_t *node = &job->nodes[e];
+        if(node->order_prev != NULL){
+            node->order_prev->order_next = node->order_next;
+        } else{
+            hs->order_first = node->order_next;
+        }
+        if(node->order_next != NULL){
+            node->order_next->order_prev = node->order_prev;
+        } else{
+            hs->order_last = node->order_prev;
+        }
+        hs->pool_dead += node->elem_len + 1;
+        node->table_next = hs->free_nodes;
+        hs->free_nodes = node;
+    }
+    hs->elem_count--;
+}
+// Removes elem 'e', a repeat of an earlier key, from the loaded set
+// the way hashset_remove() would.
+
+int hashset_load_parallel(hashset_t *hs, char *files[], int nfiles, int nthreads){
+    int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if(cpus < 1){
+        cpus = 1;
+    }
+    if(nthreads <= 0){
+        nthreads = cpus;
+    }
+    if(nthreads > HASHSET_PLOAD_PER_CPU * cpus){
+        nthreads = HASHSET_PLOAD_PER_CPU * cpus;
+    }
+    char *maps[nfiles];
+    long lens[nfiles];
+    for(int f = 0; f < nfiles; f++){
+        int fd = open(files[f], O_RDONLY);
+        struct stat st;
+        maps[f] = MAP_FAILED;
+        lens[f] = 0;
+        if(fd != -1 && fstat(fd, &st) == 0){
+            lens[f] = st.st_size;
+            maps[f] = st.st_size == 0 ? NULL : mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        if(fd != -1){
+            close(fd);
+        }
+        if(maps[f] == MAP_FAILED){
+            for(int g = 0; g < f; g++){
+                if(maps[g] != NULL){
+                    munmap(maps[g], lens[g]);
+                }
+            }
+            printf("ERROR: could not open file '%s'\n", files[f]);
+            printf("load failed\n");
+            return 0;
+        }
+    }
+    if(nfiles == 1 && lens[0] >= sizeof(HASHSET_SNAP_MAGIC) - 1 &&
+       memcmp(maps[0], HASHSET_SNAP_MAGIC, sizeof(HASHSET_SNAP_MAGIC) - 1) == 0){
+        munmap(maps[0], lens[0]);
+        return hashset_load_snapshot(hs, files[0]);
+    }
+
+    pload_job_t job = {.hs = hs, .nthreads = nthreads, .nchunks = nfiles * nthreads};
+    job.chunks = calloc(job.nchunks, sizeof(pload_chunk_t));
+    long counts[nfiles];
+    int size = HASHSET_DEFAULT_TABLE_SIZE;
+    for(int f = 0; f < nfiles; f++){
+        char *p = maps[f];
+        char *end = maps[f] + lens[f];
+        int file_size = pload_int(&p, end);
+        counts[f] = pload_int(&p, end);
+        if(f == 0){
+            size = file_size;
+        }
+        for(int t = 0; t < nthreads; t++){
+            pload_chunk_t *chunk = &job.chunks[f * nthreads + t];
+            char *cut = p + (end - p) * (t + 1) / nthreads;
+            while(cut < end && cut[-1] != '\n'){
+                cut++;
+            }
+            chunk->start = t == 0 ? p : chunk[-1].end;
+            chunk->end = t == nthreads - 1 ? end : cut;
+            if(chunk->end < chunk->start){
+                chunk->end = chunk->start;
+            }
+            chunk->region_pos = calloc(nthreads, sizeof(long));
+        }
+    }
+    pload_run(&job, pload_count_thread);
+
+    long total = 0;
+    unsigned long pool_len = 0;
+    for(int f = 0; f < nfiles; f++){
+        long left = counts[f];
+        for(int t = 0; t < nthreads; t++){
+            pload_chunk_t *chunk = &job.chunks[f * nthreads + t];
+            if(chunk->keys > left){
+                pload_scan(chunk, left);
+            }
+            left -= chunk->keys;
+            chunk->first = total;
+            chunk->pool_off = pool_len;
+            total += chunk->keys;
+            pool_len += chunk->bytes;
+        }
+    }
+
+    if(size < 1){
+        size = HASHSET_DEFAULT_TABLE_SIZE;
+    }
+    hashset_reset(hs, size);
+    while((hs->engine == HASHSET_FLAT &&
+           total * HASHSET_FLAT_LOAD_DEN > (long) hs->table_size * HASHSET_FLAT_LOAD_NUM) ||
+          (hs->max_load > 0 && total > hs->max_load * hs->table_size)){
+        hs->table_size = hashset_next_size(hs);
+    }
+    hashset_reset(hs, hs->table_size);
+    hs->elem_count = total;
+    if(pool_len > 0){
+        hs->pool = malloc(pool_len);
+        hs->pool_len = pool_len;
+        hs->pool_cap = pool_len;
+    }
+    if(total > 0 && hs->engine == HASHSET_FLAT){
+        hs->entries = malloc(total * sizeof(hashentry_t));
+        hs->entry_len = total;
+        hs->entry_cap = total;
+    } else if(total > 0){
+        hashslab_t *slab = malloc(sizeof(hashslab_t) + total * sizeof(hashnode_t));
+        slab->next = NULL;
+        slab->used = total;
+        slab->cap = total;
+        hs->slabs = slab;
+        job.nodes = slab->nodes;
+        hs->order_first = &job.nodes[0];
+        hs->order_last = &job.nodes[total - 1];
+    }
+    hs->hashfunc("", 0);                        // any lazily built tables are built once, here
+    pload_run(&job, pload_copy_thread);
+
+    job.region_start = calloc(nthreads + 1, sizeof(long));
+    long pos = 0;
+    for(int r = 0; r < nthreads; r++){
+        job.region_start[r] = pos;
+        for(int c = 0; c < job.nchunks; c++){
+            long found = job.chunks[c].region_pos[r];
+            job.chunks[c].region_pos[r] = pos;
+            pos += found;
+        }
+    }
+    job.region_start[nthreads] = pos;
+    job.order = malloc((total + 1) * sizeof(int));
+    pload_run(&job, pload_group_thread);
+
+    job.bounds = malloc((nthreads + 1) * sizeof(int));
+    for(int r = 0; r <= nthreads; r++){
+        job.bounds[r] = ((long) r * hs->table_size + nthreads - 1) / nthreads;
+    }
+    job.dups = calloc(total + 1, sizeof(char));
+    job.spills = calloc(nthreads, sizeof(int *));
+    job.spill_len = calloc(nthreads, sizeof(int));
+    job.dup_count = calloc(nthreads, sizeof(long));
+    pload_run(&job, pload_place_thread);
+
+    long dups = 0;
+    for(int r = 0; r < nthreads; r++){
+        for(int s = 0; s < job.spill_len[r]; s++){
+            int e = job.spills[r][s];
+            if(hashset_flat_claim(hs, e, -1) == 0){
+                job.dups[e] = 1;
+                dups++;
+            }
+        }
+        dups += job.dup_count[r];
+        free(job.spills[r]);
+    }
+    for(long e = 0; dups > 0 && e < total; e++){
+        if(job.dups[e]){
+            pload_drop(&job, e);
+            dups--;
+        }
+    }
+
+    if(hs->bloom != NULL){
+        hashset_bloom_build(hs);
+    }
+    for(int c = 0; c < job.nchunks; c++){
+        free(job.chunks[c].region_pos);
+    }
+    for(int f = 0; f < nfiles; f++){
+        if(maps[f] != NULL){
+            munmap(maps[f], lens[f]);
+        }
+    }
+    free(job.chunks);
+    free(job.region_start);
+    free(job.order);
+    free(job.bounds);
+    free(job.dups);
+    free(job.spills);
+    free(job.spill_len);
+    free(job.dup_count);
+    return 1;
+}
+// Loads the save files 'files' into 'hs' using 'nthreads' threads (0
+// for one per CPU, at most HASHSET_PLOAD_PER_CPU per CPU), giving the
+// same elems in the same order as hashset_load() of the files one
+// after another without clearing in between. Each file contributes
+// the number of elems in its header; the table size comes from the
+// first file and is grown up front to whatever the set's growth
+// policy would have reached, so no table is rebuilt during the load.
+// The engine, hash function and other settings of 'hs' are kept, and
+// a Bloom filter is rebuilt at the end. Chained sets come out exactly
+// as with hashset_load() unless incremental rehashing is on; flat
+// sets can differ only in which slots elems of a crowded probe run
+// occupy. If a key is repeated, the table is sized counting the
+// repeats and the dropped copies stay in the key pool as removed
+// keys. A single file that is a binary snapshot is handed to
+// hashset_load_snapshot(). If a file cannot be opened, prints an
+// error and returns 0 without changing 'hs'; otherwise returns 1.
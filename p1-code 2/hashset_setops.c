@@ -0,0 +1,188 @@
+#include "hashset.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+// hashset_setops.c: union, intersection and difference of hash sets.
+// Each operation streams the elems of one operand out with a cursor,
+// looks all of them up in the other operand with batched, prefetching
+// lookups (hashset_contains_many()) and adds the elems that belong in
+// the result, in the order they were streamed, to a new set with
+// hashset_add_many(). The lookups may be split across threads: each
+// thread probes a slice of the keys through its own copy of the probed
+// set's struct, so lookups share the table read-only and keep their
+// Bloom filter counters to themselves.
+
+typedef struct {
+    hashset_t probe;            // private copy of the struct of the set probed
+    char **keys;                // keys this thread looks up
+    int n;                      // number of them
+    int *found;                 // found[i] is set to 1 if keys[i] is in 'probe'
+} setop_worker_t;
+
+static void *setop_probe_thread(void *arg){
+    setop_worker_t *w = arg;
+    hashset_contains_many(&w->probe, w->keys, w->n, w->found);
+    return NULL;
+}
+
+static void setop_probe(hashset_t *probe, char *keys[], int n, int found[], int nthreads){
+    int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if(cpus < 1){
+        cpus = 1;
+    }
+    if(nthreads <= 0){
+        nthreads = cpus;
+    }
+    if(nthreads > HASHSET_PLOAD_PER_CPU * cpus){
+        nthreads = HASHSET_PLOAD_PER_CPU * cpus;
+    }
+    if(nthreads > n / HASHSET_BATCH){
+        nthreads = n / HASHSET_BATCH > 0 ? n / HASHSET_BATCH : 1;
+    }
+    hashset_rehash_finish(probe);
+    if(nthreads == 1){
+        hashset_contains_many(probe, keys, n, found);
+        return;
+    }
+    pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+    setop_worker_t *workers = malloc(nthreads * sizeof(setop_worker_t));
+    int *started = calloc(nthreads, sizeof(int));
+    hashset_t base = *probe;
+    for(int t = 0; t < nthreads; t++){
+        int first = (long) n * t / nthreads;
+        int last = (long) n * (t + 1) / nthreads;
+        workers[t] = (setop_worker_t) {.probe = base, .keys = &keys[first],
+                                       .n = last - first, .found = &found[first]};
+        started[t] = pthread_create(&threads[t], NULL, setop_probe_thread, &workers[t]) == 0;
+    }
+    for(int t = 0; t < nthreads; t++){
+        if(started[t]){
+            pthread_join(threads[t], NULL);
+        } else{
+            setop_probe_thread(&workers[t]);
+        }
+        probe->bloom_checks += workers[t].probe.bloom_checks - base.bloom_checks;
+        probe->bloom_rejects += workers[t].probe.bloom_rejects - base.bloom_rejects;
+        probe->bloom_false += workers[t].probe.bloom_false - base.bloom_false;
+    }
+    free(threads);
+    free(workers);
+    free(started);
+}
+// Sets found[i] to 1 if keys[i] is in 'probe' and 0 otherwise, using
+// up to 'nthreads' threads (0 for one per CPU) but no more than
+// HASHSET_PLOAD_PER_CPU per CPU and never so many that a thread gets
+// less than one batch. A pending incremental rehash of 'probe' is
+// finished first so that the lookups change nothing. The slice of a
+// thread that cannot be started is looked up on the calling thread
+// instead, as in hashset_load_parallel(). The Bloom filter counters of
+// the copies are added back afterwards.
+
+static char **setop_keys(hashset_t *hs){
+    char **keys = malloc((hs->elem_count + 1) * sizeof(char *));
+    hashset_iter_t it;
+    hashset_iter_init(&it, hs, HASHSET_ITER_ORDER);
+    hashset_iter_next_many(&it, keys, NULL, hs->elem_count);
+    return keys;
+}
+// Array of the keys of 'hs' in insertion order; the strings are those
+// in the set's key pool.
+
+static void setop_init(hashset_t *dst, hashset_t *like, int count){
+    hashset_init_engine(dst, like->table_size, like->engine);
+    dst->incremental = like->incremental;
+    dst->max_load = like->max_load;
+    dst->growth_factor = like->growth_factor;
+    dst->sizing = like->sizing;
+    dst->hashfunc = like->hashfunc;
+    while((dst->engine == HASHSET_FLAT &&
+           (long) count * HASHSET_FLAT_LOAD_DEN > (long) dst->table_size * HASHSET_FLAT_LOAD_NUM) ||
+          (dst->max_load > 0 && count > dst->max_load * dst->table_size)){
+        dst->table_size = hashset_next_size(dst);
+    }
+    hashset_reset(dst, dst->table_size);
+    if(like->bloom != NULL){
+        hashset_set_bloom(dst, 1);
+    }
+}
+// Initializes 'dst' as an empty set with the engine, hash function,
+// growth policy and Bloom filter setting of 'like', its table already
+// grown as far as its policy would take it while adding 'count' elems,
+// so that building the result never expands it.
+
+static int setop_add_selected(hashset_t *dst, char *keys[], int found[], int n, int want){
+    int kept = 0;
+    for(int i = 0; i < n; i++){
+        if(found[i] == want){
+            keys[kept++] = keys[i];
+        }
+    }
+    return hashset_add_many(dst, keys, kept);
+}
+// Adds to 'dst', in order, each keys[i] whose found[i] equals 'want',
+// compacting them to the front of 'keys'. Returns the number added.
+
+int hashset_union(hashset_t *dst, hashset_t *a, hashset_t *b, int nthreads){
+    char **keys = setop_keys(b);
+    int *found = malloc((b->elem_count + 1) * sizeof(int));
+    setop_probe(a, keys, b->elem_count, found, nthreads);
+    int extra = 0;
+    for(int i = 0; i < b->elem_count; i++){
+        extra += !found[i];
+    }
+    setop_init(dst, a, a->elem_count + extra);
+    char **akeys = setop_keys(a);
+    hashset_add_many(dst, akeys, a->elem_count);
+    setop_add_selected(dst, keys, found, b->elem_count, 0);
+    free(akeys);
+    free(keys);
+    free(found);
+    return dst->elem_count;
+}
+// Initializes 'dst' as the union of 'a' and 'b' and returns its number
+// of elems. Its elems are those of 'a' in their insertion order
+// followed by those of 'b' that are not in 'a', in the order of 'b';
+// only the elems of 'b' are looked up. 'dst' is a new set, which must
+// not be 'a' or 'b', with the engine and settings of 'a' (see
+// setop_init()). It is freed with hashset_free_fields() as usual.
+// 'nthreads' is used for the lookups as in setop_probe().
+
+int hashset_intersect(hashset_t *dst, hashset_t *a, hashset_t *b, int nthreads){
+    hashset_t *small = b->elem_count < a->elem_count ? b : a;
+    hashset_t *large = small == a ? b : a;
+    char **keys = setop_keys(small);
+    int *found = malloc((small->elem_count + 1) * sizeof(int));
+    setop_probe(large, keys, small->elem_count, found, nthreads);
+    int count = 0;
+    for(int i = 0; i < small->elem_count; i++){
+        count += found[i];
+    }
+    setop_init(dst, a, count);
+    setop_add_selected(dst, keys, found, small->elem_count, 1);
+    free(keys);
+    free(found);
+    return dst->elem_count;
+}
+// Initializes 'dst' as the intersection of 'a' and 'b' and returns its
+// number of elems. Only the smaller set is iterated, its elems looked
+// up in the larger one, so the result is in the insertion order of the
+// smaller set ('a' if they are the same size). Otherwise as for
+// hashset_union().
+
+int hashset_difference(hashset_t *dst, hashset_t *a, hashset_t *b, int nthreads){
+    char **keys = setop_keys(a);
+    int *found = malloc((a->elem_count + 1) * sizeof(int));
+    setop_probe(b, keys, a->elem_count, found, nthreads);
+    int count = 0;
+    for(int i = 0; i < a->elem_count; i++){
+        count += !found[i];
+    }
+    setop_init(dst, a, count);
+    setop_add_selected(dst, keys, found, a->elem_count, 0);
+    free(keys);
+    free(found);
+    return dst->elem_count;
+}
+// Initializes 'dst' as the elems of 'a' that are not in 'b', in the
+// insertion order of 'a', and returns their number. Every elem of 'a'
+// is looked up in 'b'. Otherwise as for hashset_union().
@@ -0,0 +1,263 @@
+#include "hashset.h"
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+// hashset_snap.c: binary snapshots of hash sets. A snapshot is the
+// header hashset_snaphdr_t followed by the control bytes, slot
+// indices, entries and key pool of a flat hash set exactly as they sit
+// in memory. hashset_load_snapshot() maps the file read-only and points
+// the set's arrays into the mapping, so loading takes the same time
+// for any number of elems: nothing is parsed, hashed or copied until
+// the set is first changed. Snapshots use the byte order and type
+// sizes of the machine that wrote them.
+
+static unsigned long snap_align(unsigned long off){
+    return (off + 7) & ~7UL;
+}
+// Rounds a file offset up to the next multiple of 8.
+
+static int snap_write_at(FILE *fp, unsigned long *pos, unsigned long off, void *data, unsigned long len){
+    static char zeros[8];
+    while(*pos < off){
+        fwrite(zeros, 1, 1, fp);
+        (*pos)++;
+    }
+    if(len > 0 && fwrite(data, 1, len, fp) != len){
+        return 0;
+    }
+    *pos += len;
+    return 1;
+}
+// Pads the file with zeros from '*pos' up to 'off' and writes 'len'
+// bytes of 'data' there. Returns 0 if the write fails.
+
+static int snap_hash_index(hashfunc_t func){
+    for(int i = 0; i < HASHSET_HASH_COUNT; i++){
+        if(hashset_hashfuncs[i].func == func){
+            return i;
+        }
+    }
+    return -1;
+}
+// Index of 'func' in hashset_hashfuncs[] or -1 for a custom function,
+// which cannot be named in a file.
+
+static void snap_flat_copy(hashset_t *hs, hashset_t *flat){
+    int size = hs->table_size;
+    while((hs->elem_count + 1) * HASHSET_FLAT_LOAD_DEN > size * HASHSET_FLAT_LOAD_NUM){
+        size = hs->sizing == HASHSET_SIZE_POW2 ? 2 * size : next_prime(2 * size + 1);
+    }
+    hashset_init_engine(flat, size, HASHSET_FLAT);
+    flat->sizing = hs->sizing;
+    flat->hashfunc = hs->hashfunc;
+    for(hashnode_t *node = hs->order_first; node != NULL; node = node->order_next){
+        hashset_flat_add(flat, HASHSET_KEY(hs, node->elem_off));
+    }
+}
+// Builds a flat copy of the chained hash set 'hs' in 'flat' with the
+// same hash function and sizing, adding elems in insertion order. The
+// copy starts at the table size of 'hs', grown if needed to stay under
+// the flat engine's maximum load.
+
+int hashset_save_snapshot(hashset_t *hs, char *filename){
+    int hash_index = snap_hash_index(hs->hashfunc);
+    if(hash_index == -1){
+        printf("ERROR: cannot snapshot a hash set using a custom hash function\n");
+        return 0;
+    }
+    hashset_snapshot_detach(hs);
+    FILE *fp = fopen(filename, "w");
+    if(fp == NULL){
+        printf("ERROR: could not open file '%s'\n", filename);
+        return 0;
+    }
+    hashset_t copy;
+    hashset_t *flat = hs;
+    if(hs->engine == HASHSET_FLAT && hs->entry_len != hs->elem_count){
+        hashset_flat_compact(hs);
+    }
+    if(hs->engine != HASHSET_FLAT){
+        snap_flat_copy(hs, &copy);
+        flat = &copy;
+    }
+
+    hashset_snaphdr_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, HASHSET_SNAP_MAGIC, sizeof(hdr.magic));
+    hdr.version = HASHSET_SNAP_VERSION;
+    hdr.byte_order = HASHSET_SNAP_BYTE_ORDER;
+    hdr.table_size = flat->table_size;
+    hdr.elem_count = flat->elem_count;
+    hdr.hashfunc = hash_index;
+    hdr.sizing = hs->sizing;
+    hdr.max_load = hs->max_load;
+    hdr.growth_factor = hs->growth_factor;
+    hdr.ctrl_off = snap_align(sizeof(hdr));
+    hdr.slots_off = snap_align(hdr.ctrl_off + flat->table_size);
+    hdr.entries_off = snap_align(hdr.slots_off + flat->table_size * sizeof(int));
+    hdr.pool_off = snap_align(hdr.entries_off + flat->elem_count * sizeof(hashentry_t));
+    hdr.pool_len = flat->pool_len;
+    hdr.file_len = hdr.pool_off + hdr.pool_len;
+
+    unsigned long pos = 0;
+    int ok = snap_write_at(fp, &pos, 0, &hdr, sizeof(hdr)) &&
+        snap_write_at(fp, &pos, hdr.ctrl_off, flat->ctrl, flat->table_size) &&
+        snap_write_at(fp, &pos, hdr.slots_off, flat->slots, flat->table_size * sizeof(int)) &&
+        snap_write_at(fp, &pos, hdr.entries_off, flat->entries, flat->elem_count * sizeof(hashentry_t)) &&
+        snap_write_at(fp, &pos, hdr.pool_off, flat->pool, flat->pool_len);
+    if(fclose(fp) != 0){
+        ok = 0;
+    }
+    if(flat == &copy){
+        hashset_free_fields(&copy);
+    }
+    if(!ok){
+        printf("ERROR: could not write file '%s'\n", filename);
+    }
+    return ok;
+}
+// Writes 'hs' to 'filename' as a binary snapshot and returns 1, or
+// prints an error and returns 0. Flat sets are written as they are,
+// after compacting away the entries of removed elements. A set loaded
+// from a snapshot is first copied off its mapping, since 'filename'
+// may be the mapped file and opening it truncates the pages the
+// writer would read.
+// Chained sets are first copied into a flat layout, possibly with a
+// larger table, since that is the layout that can be used in place;
+// loading the snapshot gives a flat set with the same elems, insertion
+// order, hash function and growth policy.
+
+static int snap_fits(hashset_snaphdr_t *hdr, unsigned long off, unsigned long len){
+    return off % 8 == 0 && off <= hdr->file_len && len <= hdr->file_len - off;
+}
+// Checks that 'len' bytes at 'off' are aligned and inside the file.
+
+static int snap_valid(hashset_snaphdr_t *hdr, unsigned long file_len){
+    return memcmp(hdr->magic, HASHSET_SNAP_MAGIC, sizeof(hdr->magic)) == 0 &&
+        hdr->version == HASHSET_SNAP_VERSION &&
+        hdr->byte_order == HASHSET_SNAP_BYTE_ORDER &&
+        hdr->file_len == file_len &&
+        hdr->table_size > 0 &&
+        hdr->elem_count >= 0 && hdr->elem_count < hdr->table_size &&
+        hdr->hashfunc >= 0 && hdr->hashfunc < HASHSET_HASH_COUNT &&
+        (hdr->sizing == HASHSET_SIZE_PRIME || hdr->sizing == HASHSET_SIZE_POW2) &&
+        snap_fits(hdr, hdr->ctrl_off, hdr->table_size) &&
+        snap_fits(hdr, hdr->slots_off, hdr->table_size * sizeof(int)) &&
+        snap_fits(hdr, hdr->entries_off, hdr->elem_count * sizeof(hashentry_t)) &&
+        snap_fits(hdr, hdr->pool_off, hdr->pool_len);
+}
+// Checks the header of a mapped snapshot against the actual file
+// length. Only the header is examined so this takes constant time;
+// the arrays themselves are trusted as written by
+// hashset_save_snapshot().
+
+int hashset_load_snapshot(hashset_t *hs, char *filename){
+    int fd = open(filename, O_RDONLY);
+    if(fd == -1){
+        printf("ERROR: could not open file '%s'\n", filename);
+        printf("load failed\n");
+        return 0;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && st.st_size >= (long) sizeof(hashset_snaphdr_t)){
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if(map == MAP_FAILED || !snap_valid(map, st.st_size)){
+        if(map != MAP_FAILED){
+            munmap(map, st.st_size);
+        }
+        printf("ERROR: '%s' is not a valid snapshot\n", filename);
+        printf("load failed\n");
+        return 0;
+    }
+
+    hashset_snaphdr_t *hdr = map;
+    char *base = map;
+    int bloom = hs->bloom != NULL;
+    hashset_free_fields(hs);
+    hs->engine = HASHSET_FLAT;
+    hs->table_size = hdr->table_size;
+    hs->elem_count = hdr->elem_count;
+    hs->mod_magic = hashset_mod_magic(hdr->table_size);
+    hs->ctrl = (unsigned char *) (base + hdr->ctrl_off);
+    hs->slots = (int *) (base + hdr->slots_off);
+    hs->entries = (hashentry_t *) (base + hdr->entries_off);
+    hs->entry_len = hdr->elem_count;
+    hs->entry_cap = hdr->elem_count;
+    hs->pool = base + hdr->pool_off;
+    hs->pool_len = hdr->pool_len;
+    hs->pool_cap = hdr->pool_len;
+    hs->hashfunc = hashset_hashfuncs[hdr->hashfunc].func;
+    hs->sizing = hdr->sizing;
+    hs->max_load = hdr->max_load;
+    hs->growth_factor = hdr->growth_factor;
+    hs->map = map;
+    hs->map_len = st.st_size;
+    if(bloom){
+        hashset_set_bloom(hs, 1);
+    }
+    return 1;
+}
+// Loads a snapshot written by hashset_save_snapshot() into 'hs' in
+// constant time: the file is mapped read-only and the flat arrays of
+// 'hs' point straight into the mapping. Whatever 'hs' held before is
+// free()'d and it becomes a flat set; a Bloom filter it had is
+// rebuilt on the heap for the loaded elems. Read-only operations use the
+// mapping directly; the first change to the set copies it to the heap
+// with hashset_snapshot_detach(). If the file cannot be opened or is
+// not a snapshot for this machine, prints an error and returns 0
+// without changing 'hs'; otherwise returns 1.
+
+void hashset_snapshot_detach(hashset_t *hs){
+    if(hs->map == NULL){
+        return;
+    }
+    int entry_len = hs->entry_len;
+    unsigned long pool_len = hs->pool_len;
+    unsigned char *ctrl = malloc(hs->table_size * sizeof(unsigned char));
+    int *slots = malloc(hs->table_size * sizeof(int));
+    hashentry_t *entries = malloc((entry_len + 1) * sizeof(hashentry_t));
+    char *pool = malloc(pool_len + 1);
+    memcpy(ctrl, hs->ctrl, hs->table_size * sizeof(unsigned char));
+    memcpy(slots, hs->slots, hs->table_size * sizeof(int));
+    memcpy(entries, hs->entries, entry_len * sizeof(hashentry_t));
+    memcpy(pool, hs->pool, pool_len);
+    hashset_snapshot_unmap(hs);
+    hs->ctrl = ctrl;
+    hs->slots = slots;
+    hs->entries = entries;
+    hs->entry_len = entry_len;
+    hs->entry_cap = entry_len + 1;
+    hs->pool = pool;
+    hs->pool_len = pool_len;
+    hs->pool_cap = pool_len + 1;
+}
+// Copies the arrays of a set loaded with hashset_load_snapshot() out of
+// the read-only mapping into heap blocks that the flat engine can
+// grow and free, then unmaps the file. Called by every flat function
+// that changes the set; does nothing if 'hs' is not mapped.
+
+void hashset_snapshot_unmap(hashset_t *hs){
+    if(hs->map == NULL){
+        return;
+    }
+    munmap(hs->map, hs->map_len);
+    hs->map = NULL;
+    hs->map_len = 0;
+    hs->ctrl = NULL;
+    hs->slots = NULL;
+    hs->entries = NULL;
+    hs->entry_len = 0;
+    hs->entry_cap = 0;
+    hs->pool = NULL;
+    hs->pool_len = 0;
+    hs->pool_cap = 0;
+}
+// Releases the mapping of a set loaded with hashset_load_snapshot()
+// and clears the array fields that pointed into it. Used by
+// hashset_free_fields(); does nothing if 'hs' is not mapped.
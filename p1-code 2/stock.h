@@ -7,6 +7,23 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Summary of a window of prices, see stock_range(): indices of the
+// first minimum, first maximum and best buy/sell pair, -1 where none.
+typedef struct {
+  int min_index;                // index of the minimum price
+  int max_index;                // index of the maximum price
+  int best_buy;                 // index at which to buy to get best profit
+  int best_sell;                // index at which to sell to get best profit
+} stock_range_t;
+
+// Range query index over a stock's prices, see stock_range.c. Node 1
+// is the root and node n has children 2n and 2n+1; leaf 'size'+i is
+// price i.
+typedef struct {
+  int size;                     // number of leaves, a power of two
+  stock_range_t *nodes;         // 2*size summaries, nodes[0] unused
+} stock_index_t;
+
 typedef struct {
   char *data_file;              // name of the data file stock data was loaded from
   int count;                    // length of prices array
@@ -15,16 +32,116 @@ typedef struct {
   int max_index;                // index of the maximum price
   int best_buy;                 // index at which to buy to get best profit
   int best_sell;                // index at which to sell to get best profit
+  int capacity;                 // allocated length of prices for stock_append(), 0 if not owned
+  int run_min;                  // earliest index of the minimum price so far, -1 if not tracked
+  stock_index_t *range_index;   // range query index kept up by stock_append(), NULL if none
 } stock_t;
 
+// One symbol of a stock_store_t: its rows are store->times[first..]
+// and store->prices[first..], 'count' of them. Analytics indices are
+// relative to 'first' as in stock_t, -1 if not known or not viable.
+typedef struct {
+  char *name;                   // symbol name, e.g. FB-08-02-2021 for data/stock-FB-08-02-2021.txt
+  char *data_file;              // name of the data file the symbol was loaded from
+  long first;                   // row of the symbol's first price in the store columns
+  int count;                    // number of rows of the symbol
+  int min_index;                // index of the minimum price
+  int max_index;                // index of the maximum price
+  int best_buy;                 // index at which to buy to get best profit
+  int best_sell;                // index at which to sell to get best profit
+} stock_symbol_t;
+
+// Columnar store of many symbols. All rows of all symbols sit in two
+// contiguous columns, the rows of each symbol back to back in the
+// order symbols were loaded, and 'index' finds a symbol by name.
+typedef struct {
+  long rows;                    // used length of the 'times' and 'prices' columns
+  long row_cap;                 // allocated length of the columns
+  int *times;                   // time of each row in seconds since midnight, see stock_parse_time()
+  double *prices;               // price of each row
+  int sym_count;                // number of symbols
+  int sym_cap;                  // allocated length of 'symbols'
+  stock_symbol_t *symbols;      // symbols in the order they were loaded
+  int index_size;               // length of 'index', a power of two
+  int *index;                   // open addressing table of positions in 'symbols', -1 for empty
+} stock_store_t;
+
+// Summary of the prices in a stream's window, see stock_stream.c:
+// times, counted from 0 for the first price of the stream, and prices
+// of the first minimum, first maximum and best buy/sell pair, times -1
+// where none.
+typedef struct {
+  long min_t;                   // time of the minimum price
+  long max_t;                   // time of the maximum price
+  long buy_t;                   // time at which to buy to get best profit
+  long sell_t;                  // time at which to sell to get best profit
+  double min;                   // minimum price
+  double max;                   // maximum price
+  double profit;                // profit of the best buy/sell pair, 0.0 if none
+} stock_window_t;
+
+// Sliding window over the last 'window' prices of a stream. Memory is
+// proportional to 'window' however many prices are pushed.
+typedef struct {
+  int window;                   // number of most recent prices analyzed
+  long seen;                    // number of prices pushed so far
+  double *ring;                 // last 'window' prices, price at time t in ring[t % window]
+  stock_window_t *older;        // stack of summaries of the older part of the window
+  int older_len;                // number of prices in the older part
+  stock_window_t newer;         // summary of the newer part of the window
+  int newer_len;                // number of prices in the newer part
+  double sum;                   // sum of the prices in the window
+  double ema;                   // exponential moving average of all prices
+} stock_stream_t;
+
 // stock_funcs.c
 void stock_print(stock_t *stock);
 stock_t *stock_new();
 void stock_free(stock_t *stock);
 void stock_set_minmax(stock_t *stock);
 int stock_set_best(stock_t *stock);
+int stock_append(stock_t *stock, double price);
 int count_lines(char *filename);
 int stock_load(stock_t *stock, char *filename);
 void stock_plot(stock_t *stock, int max_width);
+void stock_plot_rows(stock_t *stock, int max_width, int max_rows);
+double stock_parse_price(char **pos, char *end);
+
+// stock_minmax.c
+typedef void (*minmax_func_t)(double *prices, int count, int *min_index, int *max_index);
+
+typedef struct {
+  char *name;                   // name of the kernel, e.g. "avx2"
+  minmax_func_t func;           // the kernel
+  int (*usable)();              // returns 1 if this CPU can run it
+} stock_minmax_kernel_t;
+
+extern stock_minmax_kernel_t stock_minmax_kernels[];   // ends with a NULL name
+void stock_minmax(double *prices, int count, int *min_index, int *max_index);
+void stock_minmax_scalar(double *prices, int count, int *min_index, int *max_index);
+
+// stock_range.c
+void stock_index_build(stock_t *stock);
+void stock_index_free(stock_t *stock);
+void stock_index_append(stock_t *stock, int i);
+int stock_range(stock_t *stock, int i, int j, stock_range_t *range);
+
+// stock_store.c
+stock_store_t *stock_store_new();
+void stock_store_free(stock_store_t *store);
+int stock_store_load(stock_store_t *store, char *pattern);
+int stock_store_load_file(stock_store_t *store, char *filename);
+stock_symbol_t *stock_store_find(stock_store_t *store, char *name);
+void stock_store_analyze(stock_store_t *store);
+void stock_store_view(stock_store_t *store, stock_symbol_t *sym, stock_t *view);
+void stock_store_print(stock_store_t *store);
+
+// stock_stream.c
+stock_stream_t *stock_stream_new(int window);
+void stock_stream_free(stock_stream_t *stream);
+void stock_stream_push(stock_stream_t *stream, double price);
+int stock_stream_window(stock_stream_t *stream, stock_window_t *w);
+double stock_stream_sma(stock_stream_t *stream);
+void stock_stream_run(stock_stream_t *stream, FILE *in, int follow);
 
 #endif
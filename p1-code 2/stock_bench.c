@@ -0,0 +1,97 @@
+// stock_bench.c: benchmark for the min/max kernels of stock_minmax.c.
+// For every usable kernel and every size it times finding the first
+// minimum and maximum of an array of prices and writes one CSV line
+// to stdout:
+//
+//   kernel,count,bytes,reps,ns_per_call,gb_per_s,min_index,max_index
+//
+// gb_per_s is the size of the price array in bytes (1e9 bytes to the
+// GB) divided by the time of one call, so arrays much larger than the
+// caches show how close a kernel gets to memory bandwidth. Each call
+// is repeated until at least 0.2s have passed and the best repetition
+// is reported. min_index/max_index let the kernels be checked against
+// each other. Prices are a random walk so minimum and maximum fall
+// somewhere in the middle, as for real quotes.
+//
+// usage: ./stock_bench [-min N] [-max N] [-kernel scalar|sse4.1|avx2|all]
+//
+// Sizes run through the powers of ten from -min (default 1e6) to -max
+// (default 1e8); -max 1e9 works but needs 8GB for the prices.
+
+#include <time.h>
+#include "stock.h"
+
+#define BENCH_SECONDS 0.2               // least time spent repeating each measurement
+
+static double now_ns(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Fills 'prices' with a random walk starting at 100.00.
+static void make_prices(double *prices, long n){
+  unsigned long x = 0x9E3779B97F4A7C15UL;
+  double price = 100.0;
+  for(long i = 0; i < n; i++){
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    price += (double) (x % 2001) / 1000.0 - 1.0;
+    prices[i] = price;
+  }
+}
+
+int main(int argc, char *argv[]){
+  long min = 1000000, max = 100000000;
+  char *kernel_want = "all";
+  for(int a = 1; a + 1 < argc; a += 2){
+    if(strcmp(argv[a], "-min") == 0){
+      min = atof(argv[a + 1]);
+    } else if(strcmp(argv[a], "-max") == 0){
+      max = atof(argv[a + 1]);
+    } else if(strcmp(argv[a], "-kernel") == 0){
+      kernel_want = argv[a + 1];
+    } else{
+      printf("unknown option %s\n", argv[a]);
+      return 1;
+    }
+  }
+  if(min < 1 || max < min || max > 2000000000){
+    printf("usage: %s [-min N] [-max N] [-kernel scalar|sse4.1|avx2|all]\n", argv[0]);
+    return 1;
+  }
+
+  double *prices = malloc(max * sizeof(double));
+  if(prices == NULL){
+    printf("could not allocate %ld prices\n", max);
+    return 1;
+  }
+  make_prices(prices, max);
+  printf("kernel,count,bytes,reps,ns_per_call,gb_per_s,min_index,max_index\n");
+  for(long count = min; count <= max; count *= 10){
+    for(int k = 0; stock_minmax_kernels[k].name != NULL; k++){
+      stock_minmax_kernel_t *kernel = &stock_minmax_kernels[k];
+      if(!kernel->usable() ||
+         (strcmp(kernel_want, "all") != 0 && strcmp(kernel_want, kernel->name) != 0)){
+        continue;
+      }
+      int min_index, max_index, reps = 0;
+      double best = -1, start = now_ns();
+      do{
+        double t = now_ns();
+        kernel->func(prices, count, &min_index, &max_index);
+        t = now_ns() - t;
+        if(best < 0 || t < best){
+          best = t;
+        }
+        reps++;
+      } while(now_ns() - start < BENCH_SECONDS * 1e9);
+      long bytes = count * sizeof(double);
+      printf("%s,%ld,%ld,%d,%.0f,%.2f,%d,%d\n", kernel->name, count, bytes, reps,
+             best, bytes / best, min_index, max_index);
+    }
+  }
+  free(prices);
+  return 0;
+}
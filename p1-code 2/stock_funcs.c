@@ -1,6 +1,10 @@
 // stock_funcs.c: support functions for the stock_main program.
 
 #include "stock.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // PROBLEM 1: Allocate a new stock struct and initialize its fields.
 // Integer fields like 'count' and 'min_index' should be initialied to
@@ -17,6 +21,9 @@ stock_t *stock_new(){
   stock->max_index = -1;
   stock->best_buy = -1;
   stock->best_sell = -1;
+  stock->capacity = 0;
+  stock->run_min = -1;
+  stock->range_index = NULL;
   return stock;
 }
 
@@ -24,11 +31,13 @@ stock_t *stock_new(){
 // if they are non-NULL, then free them. Then free the pointer to
 // 'stock' itself.
 void stock_free(stock_t *stock){
-  if(&stock->data_file != NULL){
+  if(stock->data_file != NULL){
     free(stock->data_file);
+  }
+  if(stock->prices != NULL){
     free(stock->prices);
-    
   }
+  stock_index_free(stock);
   free(stock);
   return;
 }
@@ -121,32 +130,41 @@ void stock_print(stock_t *stock){
 
 // PROBLEM 1: Sets the index of 'min_index' and 'max_index' fields of
 // the stock to be the positions in 'prices' of the minimum and
-// maximum values present in it. Uses a simple loop over the array
-// 'prices' which is 'count' elements long to examine each for
-// max/min. If 'count' is zero, makes no changes to 'min_index' and
-// 'max_index'.
+// maximum values present in it, the first position of each if it
+// occurs more than once. The scan over the 'count' prices is done by
+// stock_minmax(), which compares several prices per instruction on
+// CPUs with vector units. If 'count' is zero, sets both to -1.
 void stock_set_minmax(stock_t *stock){
-  stock->min_index = 1;
-  stock->max_index = 1;
-  if(stock->count == 0){
-    stock->min_index = -1;
-    stock->max_index = -1;
-  } 
-  if (stock->count == 1){
-    stock->min_index = 0;
-    stock->max_index = 0;
-  }
-  for (int i = 0; i < stock->count; i++){
-    if (stock->prices[i] < stock->prices[stock->min_index]){
-      stock->min_index = i;
-    }
-    if (stock->prices[i] > stock->prices[stock->max_index]){
-      stock->max_index = i;
-    }
-  }
+  stock_minmax(stock->prices, stock->count, &stock->min_index, &stock->max_index);
   return;
 }
   
+// Extends the best buy/sell pair of prices[0..i-1] to prices[0..i].
+// Selling at 'i' is best paired with buying at 'run_min', the earliest
+// minimum before 'i'; the pair replaces the current best only if its
+// profit is positive and strictly larger, so among equal profits the
+// earliest sell wins. Its buy is then also the earliest of any pair
+// with the best profit, giving the same pair as trying buy indices in
+// order with all later sell indices.
+static void stock_best_step(stock_t *stock, int i){
+  double *prices = stock->prices;
+  if(stock->run_min == -1){
+    stock->run_min = i;
+    return;
+  }
+  double best = 0.0;
+  if(stock->best_buy != -1){
+    best = prices[stock->best_sell] - prices[stock->best_buy];
+  }
+  if(prices[i] - prices[stock->run_min] > best){
+    stock->best_buy = stock->run_min;
+    stock->best_sell = i;
+  }
+  if(prices[i] < prices[stock->run_min]){
+    stock->run_min = i;
+  }
+}
+
 // PROBLEM 2: Sets the 'best_buy' and 'best_sell' fields of 'stock'.
 // This corresponds to the pair which produces the best profit. On
 // determining the best buy/sell indices which produce a positive
@@ -158,38 +176,76 @@ void stock_set_minmax(stock_t *stock){
 // profit, the best buy/sell indices are set to 5,7.
 // 
 // ALGORITHM NOTES
-// One intuitive algorithm to compute this is to try every possible
-// buy index (outer loop) and every possible sell index after it
-// (inner loop) looking for the maximum profit produced in it. This is
-// a O(N^2) algorithm with N=count.  Using this algorithm is a good
-// start. Some MAKEUP CREDIT will be awarded for implementing a more
-// efficient, O(N) algorithm here. See the specification for more details.
+// Rather than trying every buy index against every later sell index,
+// which is O(N^2) with N=count, this makes one O(N) pass with
+// stock_best_step(): the best buy for a sell at index i is always the
+// minimum price before i, so it is enough to track that running
+// minimum and the best spread seen against it. The running minimum is
+// kept in 'run_min' so that stock_append() can extend the result one
+// price at a time.
 int stock_set_best(stock_t *stock){
-  double profit_current;
-  double max_profit = 0.00;
-  int bestB = -1;
-  int bestS = -1;
-  
+  stock->best_buy = -1;
+  stock->best_sell = -1;
+  stock->run_min = -1;
   for(int i = 0; i < stock->count; i++){
-    for(int j = i + 1; j < stock->count; j++){
-      
-      profit_current = stock->prices[j] - stock->prices[i];
-      if(profit_current > max_profit){
-      
-        max_profit = profit_current;
-        bestB = i;
-        bestS = j;
+    stock_best_step(stock, i);
+  }
+  if(stock->best_buy == -1){
+    return -1;
+  }
+  return 0;
+}
 
-      }
-    }
+// Appends 'price' to the end of the 'prices' of 'stock', growing the
+// array by doubling as needed, and updates 'min_index', 'max_index',
+// 'best_buy' and 'best_sell' for the new price in O(1) time. Those
+// fields must be up to date for the existing prices, which is the
+// case for a stock fresh from stock_new() or after calls to
+// stock_set_minmax() and stock_set_best(); if 'min_index' or
+// 'run_min' is still -1 for a non-empty stock they are all first
+// computed from scratch, so a stock filled in by hand with the
+// analytics fields at -1 works even if 'run_min' was left 0. A range
+// index built with stock_index_build() is kept up to date as well.
+// Returns 0 if a profitable buy/sell pair exists afterwards and -1
+// otherwise, like stock_set_best().
+//
+// Only 'prices' that the stock owns, as allocated by stock_load() or
+// stock_append() itself, are grown in place. Prices the stock does not
+// own, marked by a 'capacity' of 0 or less than 'count' as for a
+// caller's array or a stock_store_view(), are first copied into a new
+// heap array, leaving the borrowed array untouched. The stock then
+// owns the copy, which must be free()'d, e.g. by stock_free().
+int stock_append(stock_t *stock, double price){
+  if(stock->count < 0){
+    stock->count = 0;
   }
-  if (max_profit > 0){
-    stock->best_buy = bestB;
-    stock->best_sell = bestS;
-    return 0;
-  }else{
-    stock->best_buy = -1;
-    stock->best_sell = -1;
+  if(stock->capacity < stock->count || (stock->capacity == 0 && stock->prices != NULL)){
+    double *owned = malloc(sizeof(double) * (stock->count + 16));
+    memcpy(owned, stock->prices, sizeof(double) * stock->count);
+    stock->prices = owned;
+    stock->capacity = stock->count + 16;
+  }
+  if(stock->count > 0 && (stock->min_index == -1 || stock->run_min == -1)){
+    stock_set_minmax(stock);
+    stock_set_best(stock);
+  }
+  if(stock->count == stock->capacity){
+    stock->capacity = stock->capacity == 0 ? 16 : 2 * stock->capacity;
+    stock->prices = realloc(stock->prices, sizeof(double) * stock->capacity);
+  }
+  int i = stock->count++;
+  stock->prices[i] = price;
+  if(i == 0 || price < stock->prices[stock->min_index]){
+    stock->min_index = i;
+  }
+  if(i == 0 || price > stock->prices[stock->max_index]){
+    stock->max_index = i;
+  }
+  stock_best_step(stock, i);
+  if(stock->range_index != NULL){
+    stock_index_append(stock, i);
+  }
+  if(stock->best_buy == -1){
     return -1;
   }
   return 0;
@@ -222,13 +278,67 @@ int count_lines(char *filename){
   return count;
 }
 
+// Powers of ten that are exact as doubles, for stock_parse_price().
+static const double pow10_table[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Parses the number that starts at '*pos', reading no further than
+// 'end', and advances '*pos' past it. Plain decimals like 358.9400 or
+// -12.5 are read as an integer of up to 2^53 and then divided by a
+// power of ten; both are exact doubles, so the one rounding in the
+// division gives the same result as strtod(). Anything else, such as
+// exponents or longer digit strings, is copied out and handed to
+// strtod(). Returns 0.0 if there is no number at '*pos'.
+double stock_parse_price(char **pos, char *end){
+  char *p = *pos;
+  char *start = p;
+  int negative = 0;
+  if(p < end && (*p == '-' || *p == '+')){
+    negative = *p == '-';
+    p++;
+  }
+  unsigned long mantissa = 0;
+  int digits = 0, frac = 0;
+  while(p < end && *p >= '0' && *p <= '9'){
+    mantissa = mantissa * 10 + (*p - '0');
+    digits++;
+    p++;
+  }
+  if(p < end && *p == '.'){
+    p++;
+    while(p < end && *p >= '0' && *p <= '9'){
+      mantissa = mantissa * 10 + (*p - '0');
+      digits++;
+      frac++;
+      p++;
+    }
+  }
+  if(digits <= 18 && mantissa <= (1UL << 53) && (p == end || (*p != 'e' && *p != 'E'))){
+    *pos = p;
+    double value = frac == 0 ? (double) mantissa : mantissa / pow10_table[frac];
+    return negative ? -value : value;
+  }
+  char buf[128];
+  int len = 0;
+  for(p = start; p < end && len < 127 && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r'; p++){
+    buf[len++] = *p;
+  }
+  buf[len] = '\0';
+  char *stop;
+  double value = strtod(buf, &stop);
+  *pos = start + (stop - buf);
+  return value;
+}
+
 // PROBLEM 2: Loads a stock from file 'filename' into 'stock' filling
-// its 'prices' and 'count' fields in. Makes use of the count_lines()
-// function to determine how many lines are in the file which will
-// dictate 'count' and the length of 'prices'. Allocates space in the
-// heap for the stock's 'prices' array, opens the 'filename' and
-// iterates through reading prices into the array. The data format for
-// prices files is
+// its 'prices' and 'count' fields in. The file is mapped into memory
+// with mmap() rather than read through stdio and is then examined
+// twice in place: one memchr() pass counts the '\n' characters, as
+// count_lines() does, which dictates 'count' and the length of the
+// heap-allocated 'prices' array, and a second pass parses one price
+// per line. The data format for prices files is
 //
 // time_03 133.00
 // time_04 143.00
@@ -236,9 +346,14 @@ int count_lines(char *filename){
 // time_06 91.00
 // 
 // where each line has a time as as single string and a price which is
-// floating point number. The times can be ignored which can be
-// accomplished with a fscanf() call with format "%*s" to read a
-// string but ignore/discard it.
+// floating point number. The times are skipped and the prices are
+// parsed with stock_parse_price(); a line with no price gets 0.0.
+//
+// A stock that was loaded before can be loaded again: its old
+// 'prices', 'data_file' and range index are free()'d as by
+// stock_free() and 'min_index', 'max_index', 'best_buy', 'best_sell'
+// and 'run_min' go back to -1 so they are recomputed for the new
+// prices, e.g. by stock_append().
 // 
 // Assigns the 'datafile' field to be a duplicated string of
 // 'filename' for which 'strdup()' is extremely useful. This string
@@ -253,28 +368,63 @@ int count_lines(char *filename){
 // with 'filename' substituted in for the name of the stock and
 // returns -1.
 int stock_load(stock_t *stock, char *filename){
-  
-  FILE *fp = fopen(filename, "r");
-  
-  
-  if(fp == NULL){
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  char *map = MAP_FAILED;
+  if(fd != -1 && fstat(fd, &st) == 0){
+    map = st.st_size == 0 ? NULL : mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  if(fd != -1){
+    close(fd);
+  }
+  if(map == MAP_FAILED){
     printf("Could not open file '%s'\n", filename);
     printf("Unable to open stock file '%s', bailing out\n", filename);
     return -1;
-   }
-   int lines = count_lines(filename);
-   stock->prices = malloc(sizeof(double)*lines);
-   stock->count = lines;
-   for(int i = 0; i < lines; i++){
-  
-    fscanf(fp, "%*s");
-    fscanf(fp, "%lf", &stock->prices[i]);
-
-   }
-   stock->data_file = strdup(filename);
-   fclose(fp);
+  }
+  char *end = map + st.st_size;
+  if(map != NULL){
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+  }
 
-  
+  int lines = 0;
+  for(char *p = map; p < end && (p = memchr(p, '\n', end - p)) != NULL; p++){
+    lines++;
+  }
+  stock_index_free(stock);
+  if(stock->data_file != NULL){
+    free(stock->data_file);
+  }
+  if(stock->prices != NULL){
+    free(stock->prices);
+  }
+  stock->min_index = -1;
+  stock->max_index = -1;
+  stock->best_buy = -1;
+  stock->best_sell = -1;
+  stock->run_min = -1;
+  stock->capacity = lines > 0 ? lines : 1;    // never 0, which would mean not owned
+  stock->prices = malloc(sizeof(double)*stock->capacity);
+  stock->count = lines;
+  char *p = map;
+  for(int i = 0; i < lines; i++){
+    char *eol = memchr(p, '\n', end - p);
+    while(p < eol && (*p == ' ' || *p == '\t')){   // leading blanks
+      p++;
+    }
+    while(p < eol && *p != ' ' && *p != '\t'){     // time
+      p++;
+    }
+    while(p < eol && (*p == ' ' || *p == '\t')){
+      p++;
+    }
+    stock->prices[i] = stock_parse_price(&p, eol);
+    p = eol + 1;
+  }
+  stock->data_file = strdup(filename);
+  if(map != NULL){
+    munmap(map, st.st_size);
+  }
   return 0;
 }
 
@@ -315,77 +465,141 @@ int stock_load(stock_t *stock, char *filename){
 //|    | +-> Print MIN or MAX if the stock is at min_index/max_index
 //|    +-> Print B or S if the stock is at the best_buy/best_sell index
 //+--> Index in the array printed with format %3d
+//
+// Rows are formatted into a buffer, each bar filled in with memset(),
+// and written to stdout in blocks of about PLOT_BLOCK bytes, so the
+// plot costs a few calls per row rather than one printf() per hash.
 void stock_plot(stock_t *stock, int max_width){
-  printf("max_width: %d\n", max_width);
+  stock_plot_rows(stock, max_width, 0);
+}
 
-  double range = stock->prices[stock->max_index] - stock->prices[stock->min_index];
-  double plot_step = range / max_width;
+#define PLOT_BLOCK 65536        // bytes of plot rows buffered between writes
+#define PLOT_LABEL 1024         // room for a row's label, enough for any two %8.2f prices
 
-  printf("range:  %8.2f\n", range);
-  printf("plot step: %.2f\n", plot_step);
-  
-  for(int i = 0; i < max_width; i++){
-    if(i == 0){
-      printf("              +");
-    }
-    printf("-");
+// Returns the printf() format of the label of row 'i' of a plot, which
+// marks the minimum, maximum and best buy/sell prices of 'stock'.
+static char *plot_format(stock_t *stock, int i){
+  if(i == stock->min_index){
+    return i == stock->best_buy ? "\n%3d: B MIN %6.2f |" : "\n%3d: MIN%8.2f |";
   }
-  
+  if(i == stock->best_buy){
+    return "\n%3d: B%8.2f |";
+  }
+  if(i == stock->max_index){
+    return i == stock->best_sell ? "\n%3d: S MAX%8.2f |" : "\n%3d: MAX%8.2f |";
+  }
+  if(i == stock->best_sell){
+    return "\n%3d: S%8.2f |";
+  }
+  return "\n%3d:    %8.2f |";
+}
 
-  for(int i = 0; i < stock->count; i++){
-    
-    
-    int pounds = (stock->prices[i] - stock->prices[stock->min_index]) / plot_step;
+// Returns the number of hashes in the bar of 'price' for a plot whose
+// bars start at 'low' and gain a hash every 'plot_step', between 0 and
+// 'max_width'. A 'plot_step' of 0 for a flat stock gives empty bars.
+static int plot_pounds(double price, double low, double plot_step, int max_width){
+  double pounds = (price - low) / plot_step;
+  if(!(pounds > 0)){
+    return 0;
+  }
+  if(pounds >= max_width){
+    return max_width;
+  }
+  return (int) pounds;
+}
 
-    if(i == stock->min_index){
-      if(i == stock->best_buy){
-        printf("\n%3d: B MIN %6.2f |", i, stock->prices[i]);
-      } else{
-        printf("\n%3d: MIN%8.2f |", i, stock->prices[i]);
+// Fills 'marks' with the markers for the rows of a downsampled plot
+// covering prices[first..first+n-1]: B, S, MIN and MAX for each of
+// 'best_buy', 'best_sell', 'min_index' and 'max_index' in that span.
+static void plot_marks(stock_t *stock, int first, int n, char *marks){
+  int at[4] = {stock->best_buy, stock->best_sell, stock->min_index, stock->max_index};
+  char *names[4] = {"B", "S", "MIN", "MAX"};
+  marks[0] = '\0';
+  for(int m = 0; m < 4; m++){
+    if(at[m] >= first && at[m] < first + n){
+      if(marks[0] != '\0'){
+        strcat(marks, " ");
       }
-      
-      for(int j = 0; j < pounds; j++){
-        printf("#");
-     }
+      strcat(marks, names[m]);
     }
+  }
+}
 
-    else if(i == stock->best_buy){  
-      printf("\n%3d: B%8.2f |", i, stock->prices[i]);
-      for(int j = 0; j < pounds; j++){
-        printf("#");
-     }
-    }
+// Plots 'stock' like stock_plot() but with at most 'max_rows' rows
+// below the header; 'max_rows' of 0 or less means one row per price as
+// stock_plot() does. If there are more prices than rows, each row
+// covers a bucket of consecutive prices and shows the index of its
+// first price, the markers of the prices in it, and its lowest and
+// highest price. Its bar is hashes up to the lowest price and '='
+// from there to the highest, so the spread within the bucket shows:
+//
+// bucket: 4 prices per row
+//               +-------------------------
+//       0: B              27.00   292.00 |#=====================
+//       4: S MAX         142.00   323.00 |##########===============
+//       8: MIN            14.00   321.00 |========================
+//      12:               156.00   169.00 |###########=
+//
+// Finding each bucket's lowest and highest price uses stock_minmax(),
+// so the cost beyond one pass over the prices is bounded by the size
+// of the plot rather than the number of prices.
+void stock_plot_rows(stock_t *stock, int max_width, int max_rows){
+  printf("max_width: %d\n", max_width);
 
-    else if(i == stock->max_index){
-      if(i == stock->best_sell){
-        printf("\n%3d: S MAX%8.2f |", i, stock->prices[i]);
-      } else {
-        printf("\n%3d: MAX%8.2f |", i, stock->prices[i]);
-      }
-      
-      for(int j = 0; j < pounds; j++){
-        printf("#");
-    }
-    }
+  double low = 0.0, range = 0.0;
+  if(stock->count > 0 && stock->min_index != -1 && stock->max_index != -1){
+    low = stock->prices[stock->min_index];
+    range = stock->prices[stock->max_index] - low;
+  }
+  double plot_step = range / max_width;
 
-    else if(i == stock->best_sell){
-      printf("\n%3d: S%8.2f |", i, stock->prices[i]);
-      for(int j = 0; j < pounds; j++){
-        printf("#");
-     }
-    }
+  printf("range:  %8.2f\n", range);
+  printf("plot step: %.2f\n", plot_step);
 
-    else{
-      printf("\n%3d:    %8.2f |", i, stock->prices[i]);
-     for(int j = 0; j < pounds; j++){
-       printf("#");
-      }
-    }
+  int rows = stock->count > 0 ? stock->count : 0, bucket = 1;
+  if(max_rows > 0 && rows > max_rows){
+    bucket = (rows + max_rows - 1) / max_rows;
+    rows = (rows + bucket - 1) / bucket;
+    printf("bucket: %d prices per row\n", bucket);
+  }
 
-    
+  int width = max_width > 0 ? max_width : 0;
+  int row_max = PLOT_LABEL + width;
+  char *buf = malloc(PLOT_BLOCK + row_max);
+  int len = 0;
+  if(width > 0){
+    len += sprintf(buf, "              +");
+    memset(&buf[len], '-', width);
+    len += width;
+  }
 
+  for(int r = 0; r < rows; r++){
+    if(len + row_max > PLOT_BLOCK){
+      fwrite(buf, 1, len, stdout);
+      len = 0;
+    }
+    int solid, spread = 0;
+    if(bucket == 1){
+      len += sprintf(&buf[len], plot_format(stock, r), r, stock->prices[r]);
+      solid = plot_pounds(stock->prices[r], low, plot_step, width);
+    } else{
+      int first = r * bucket;
+      int n = stock->count - first < bucket ? stock->count - first : bucket;
+      int lo, hi;
+      char marks[16];
+      stock_minmax(&stock->prices[first], n, &lo, &hi);
+      plot_marks(stock, first, n, marks);
+      len += sprintf(&buf[len], "\n%7d: %-11s %8.2f %8.2f |", first, marks,
+                     stock->prices[first + lo], stock->prices[first + hi]);
+      solid = plot_pounds(stock->prices[first + lo], low, plot_step, width);
+      spread = plot_pounds(stock->prices[first + hi], low, plot_step, width) - solid;
+    }
+    memset(&buf[len], '#', solid);
+    len += solid;
+    memset(&buf[len], '=', spread);
+    len += spread;
   }
-  printf("\n");
-  return;
+  buf[len++] = '\n';
+  fwrite(buf, 1, len, stdout);
+  free(buf);
 }
-  
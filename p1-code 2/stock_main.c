@@ -1,14 +1,69 @@
 // stock_main.c: Load a stock file and print it. This file is complete
 // and does not require modification. However, the functions in
 // stock_funcs.c must be completed to make it functional.
+//
+// Given several stock files or a quoted pattern such as
+// 'data/stock-*.txt', loads them all into one stock_store_t and
+// prints a summary line per symbol instead of a plot.
+//
+// With -stream, reads prices from a file, or from standard input if
+// the file is - or missing, and prints a line of sliding window
+// analytics over the last <window> prices after each one, see
+// stock_stream.c. With -f it keeps following the file as it grows.
+//
+// When printing to a terminal, a plot with more prices than fit on the
+// screen is downsampled to the terminal's height, see
+// stock_plot_rows().
 
 #include "stock.h"
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#define PLOT_MARGIN 14          // lines printed around the plot rows, kept on screen
 
 int main(int argc, char *argv[]){
   if(argc < 3){
     printf("usage: %s <max_width> <stockfile>\n",argv[0]);
+    printf("       %s <max_width> <stockfile|pattern>...\n",argv[0]);
+    printf("       %s -stream <window> [-f] [<stockfile>|-]\n",argv[0]);
     return 1;
   }
+
+  if(strcmp(argv[1], "-stream") == 0){
+    int window = atoi(argv[2]);
+    int follow = argc > 3 && strcmp(argv[3], "-f") == 0;
+    char *filename = argc > 3 + follow ? argv[3 + follow] : "-";
+    if(window < 1){
+      printf("Window must be at least 1, got '%s'\n", argv[2]);
+      return 1;
+    }
+    FILE *in = stdin;
+    if(strcmp(filename, "-") != 0){
+      in = fopen(filename, "r");
+      if(in == NULL){
+        printf("Could not open file '%s'\n", filename);
+        return 1;
+      }
+    }
+    stock_stream_t *stream = stock_stream_new(window);
+    stock_stream_run(stream, in, follow);
+    stock_stream_free(stream);
+    if(in != stdin){
+      fclose(in);
+    }
+    return 0;
+  }
+
+  if(argc > 3 || strpbrk(argv[2], "*?[") != NULL){
+    stock_store_t *store = stock_store_new();
+    for(int i = 2; i < argc; i++){
+      stock_store_load(store, argv[i]);
+    }
+    stock_store_analyze(store);
+    stock_store_print(store);
+    stock_store_free(store);
+    return 0;
+  }
   
   int max_width = atoi(argv[1]); // read width from command line
   char *filename = argv[2];      // read filename from command line
@@ -27,7 +82,12 @@ int main(int argc, char *argv[]){
   }
 
   stock_print(stock);
-  stock_plot(stock, max_width);
+  int max_rows = 0;
+  struct winsize ws;
+  if(isatty(STDOUT_FILENO) && ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0){
+    max_rows = ws.ws_row > 2 * PLOT_MARGIN ? ws.ws_row - PLOT_MARGIN : PLOT_MARGIN;
+  }
+  stock_plot_rows(stock, max_width, max_rows);
 
   stock_free(stock);
 
@@ -0,0 +1,206 @@
+// stock_minmax.c: min/max-with-index kernels over price arrays, used
+// by stock_set_minmax(). Every kernel finds the first occurrence of the
+// minimum and of the maximum, so they all give identical indices; the
+// vector kernels just look at 2 (SSE4.1) or 4 (AVX2) prices at a time.
+// stock_minmax() picks the widest kernel the CPU supports at run time,
+// so the program needs no -m flags. This file alone is compiled with
+// -O2 (see the Makefile): unoptimized, every intrinsic goes through
+// memory and the vector kernels are slower than the plain loop.
+//
+// The vector kernels keep, per lane, the smallest and largest price
+// seen in that lane along with its index, updating only on a strictly
+// smaller or larger price so each lane holds its first occurrence.
+// Indices are kept as doubles, exact up to 2^53, so that values and
+// indices can be selected with the same compare mask. At the end the
+// lanes are combined, preferring the lower index among equal prices,
+// and the leftover prices past the last full vector are handled one
+// at a time.
+
+#include "stock.h"
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#define STOCK_MINMAX_X86 1
+#include <immintrin.h>
+#endif
+
+// Portable kernel: a plain loop keeping the current minimum and
+// maximum prices in locals rather than re-reading them through their
+// indices.
+void stock_minmax_scalar(double *prices, int count, int *min_index, int *max_index){
+  if(count <= 0){
+    *min_index = -1;
+    *max_index = -1;
+    return;
+  }
+  int min = 0, max = 0;
+  double lo = prices[0], hi = prices[0];
+  for(int i = 1; i < count; i++){
+    if(prices[i] < lo){
+      lo = prices[i];
+      min = i;
+    }
+    if(prices[i] > hi){
+      hi = prices[i];
+      max = i;
+    }
+  }
+  *min_index = min;
+  *max_index = max;
+}
+
+// Combines 'lanes' per-lane results into the first minimum/maximum of
+// the prices before 'done', then finishes the prices from 'done' on.
+static void minmax_finish(double *prices, int count, int done, int lanes,
+                          double *lo, double *lo_at, double *hi, double *hi_at,
+                          int *min_index, int *max_index){
+  int min = lo_at[0], max = hi_at[0];
+  for(int l = 1; l < lanes; l++){
+    if(lo[l] < prices[min] || (lo[l] == prices[min] && lo_at[l] < min)){
+      min = lo_at[l];
+    }
+    if(hi[l] > prices[max] || (hi[l] == prices[max] && hi_at[l] < max)){
+      max = hi_at[l];
+    }
+  }
+  for(int i = done; i < count; i++){
+    if(prices[i] < prices[min]){
+      min = i;
+    }
+    if(prices[i] > prices[max]){
+      max = i;
+    }
+  }
+  *min_index = min;
+  *max_index = max;
+}
+
+#ifdef STOCK_MINMAX_X86
+// SSE4.1 kernel, 2 prices per step in two independent sets of lanes
+// like the AVX2 kernel below.
+__attribute__((target("sse4.1")))
+static void stock_minmax_sse41(double *prices, int count, int *min_index, int *max_index){
+  if(count < 8){
+    stock_minmax_scalar(prices, count, min_index, max_index);
+    return;
+  }
+  __m128d lo0 = _mm_loadu_pd(prices), hi0 = lo0;
+  __m128d lo1 = _mm_loadu_pd(&prices[2]), hi1 = lo1;
+  __m128d at0 = _mm_set_pd(1.0, 0.0), lo_at0 = at0, hi_at0 = at0;
+  __m128d at1 = _mm_set_pd(3.0, 2.0), lo_at1 = at1, hi_at1 = at1;
+  __m128d step = _mm_set1_pd(4.0);
+  int i;
+  for(i = 4; i + 4 <= count; i += 4){
+    __m128d x0 = _mm_loadu_pd(&prices[i]);
+    __m128d x1 = _mm_loadu_pd(&prices[i + 2]);
+    at0 = _mm_add_pd(at0, step);
+    at1 = _mm_add_pd(at1, step);
+    __m128d lt0 = _mm_cmplt_pd(x0, lo0);
+    __m128d lt1 = _mm_cmplt_pd(x1, lo1);
+    __m128d gt0 = _mm_cmpgt_pd(x0, hi0);
+    __m128d gt1 = _mm_cmpgt_pd(x1, hi1);
+    lo0 = _mm_blendv_pd(lo0, x0, lt0);
+    lo1 = _mm_blendv_pd(lo1, x1, lt1);
+    lo_at0 = _mm_blendv_pd(lo_at0, at0, lt0);
+    lo_at1 = _mm_blendv_pd(lo_at1, at1, lt1);
+    hi0 = _mm_blendv_pd(hi0, x0, gt0);
+    hi1 = _mm_blendv_pd(hi1, x1, gt1);
+    hi_at0 = _mm_blendv_pd(hi_at0, at0, gt0);
+    hi_at1 = _mm_blendv_pd(hi_at1, at1, gt1);
+  }
+  double l[4], la[4], h[4], ha[4];
+  _mm_storeu_pd(l, lo0);
+  _mm_storeu_pd(&l[2], lo1);
+  _mm_storeu_pd(la, lo_at0);
+  _mm_storeu_pd(&la[2], lo_at1);
+  _mm_storeu_pd(h, hi0);
+  _mm_storeu_pd(&h[2], hi1);
+  _mm_storeu_pd(ha, hi_at0);
+  _mm_storeu_pd(&ha[2], hi_at1);
+  minmax_finish(prices, count, i, 4, l, la, h, ha, min_index, max_index);
+}
+
+// AVX2 kernel, 4 prices per step with two independent sets of lanes
+// so consecutive steps do not wait on each other's blends; the two
+// sets cover alternating vectors and are combined at the end like
+// any other lanes.
+__attribute__((target("avx2")))
+static void stock_minmax_avx2(double *prices, int count, int *min_index, int *max_index){
+  if(count < 16){
+    stock_minmax_scalar(prices, count, min_index, max_index);
+    return;
+  }
+  __m256d lo0 = _mm256_loadu_pd(prices), hi0 = lo0;
+  __m256d lo1 = _mm256_loadu_pd(&prices[4]), hi1 = lo1;
+  __m256d at0 = _mm256_set_pd(3.0, 2.0, 1.0, 0.0), lo_at0 = at0, hi_at0 = at0;
+  __m256d at1 = _mm256_set_pd(7.0, 6.0, 5.0, 4.0), lo_at1 = at1, hi_at1 = at1;
+  __m256d step = _mm256_set1_pd(8.0);
+  int i;
+  for(i = 8; i + 8 <= count; i += 8){
+    __m256d x0 = _mm256_loadu_pd(&prices[i]);
+    __m256d x1 = _mm256_loadu_pd(&prices[i + 4]);
+    at0 = _mm256_add_pd(at0, step);
+    at1 = _mm256_add_pd(at1, step);
+    __m256d lt0 = _mm256_cmp_pd(x0, lo0, _CMP_LT_OQ);
+    __m256d lt1 = _mm256_cmp_pd(x1, lo1, _CMP_LT_OQ);
+    __m256d gt0 = _mm256_cmp_pd(x0, hi0, _CMP_GT_OQ);
+    __m256d gt1 = _mm256_cmp_pd(x1, hi1, _CMP_GT_OQ);
+    lo0 = _mm256_blendv_pd(lo0, x0, lt0);
+    lo1 = _mm256_blendv_pd(lo1, x1, lt1);
+    lo_at0 = _mm256_blendv_pd(lo_at0, at0, lt0);
+    lo_at1 = _mm256_blendv_pd(lo_at1, at1, lt1);
+    hi0 = _mm256_blendv_pd(hi0, x0, gt0);
+    hi1 = _mm256_blendv_pd(hi1, x1, gt1);
+    hi_at0 = _mm256_blendv_pd(hi_at0, at0, gt0);
+    hi_at1 = _mm256_blendv_pd(hi_at1, at1, gt1);
+  }
+  double l[8], la[8], h[8], ha[8];
+  _mm256_storeu_pd(l, lo0);
+  _mm256_storeu_pd(&l[4], lo1);
+  _mm256_storeu_pd(la, lo_at0);
+  _mm256_storeu_pd(&la[4], lo_at1);
+  _mm256_storeu_pd(h, hi0);
+  _mm256_storeu_pd(&h[4], hi1);
+  _mm256_storeu_pd(ha, hi_at0);
+  _mm256_storeu_pd(&ha[4], hi_at1);
+  minmax_finish(prices, count, i, 8, l, la, h, ha, min_index, max_index);
+}
+
+static int sse41_usable(){
+  return __builtin_cpu_supports("sse4.1");
+}
+
+static int avx2_usable(){
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
+static int always_usable(){
+  return 1;
+}
+
+// Kernels from narrowest to widest; stock_minmax() uses the last one
+// that is usable on this CPU.
+stock_minmax_kernel_t stock_minmax_kernels[] = {
+  {"scalar", stock_minmax_scalar, always_usable},
+#ifdef STOCK_MINMAX_X86
+  {"sse4.1", stock_minmax_sse41,  sse41_usable},
+  {"avx2",   stock_minmax_avx2,   avx2_usable},
+#endif
+  {NULL, NULL, NULL},
+};
+
+// Sets '*min_index' and '*max_index' to the indices of the first
+// minimum and first maximum of prices[0..count-1], or both to -1 if
+// 'count' is 0 or less, using the widest usable kernel. The choice is
+// made on the first call and remembered.
+void stock_minmax(double *prices, int count, int *min_index, int *max_index){
+  static minmax_func_t best = NULL;
+  if(best == NULL){
+    for(int k = 0; stock_minmax_kernels[k].name != NULL; k++){
+      if(stock_minmax_kernels[k].usable()){
+        best = stock_minmax_kernels[k].func;
+      }
+    }
+  }
+  best(prices, count, min_index, max_index);
+}
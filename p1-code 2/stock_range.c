@@ -0,0 +1,142 @@
+// stock_range.c: range query index over the prices of a stock. The
+// index is a segment tree: a complete binary tree over the price
+// array whose every node summarizes its span of prices with the
+// indices of the first minimum, the first maximum and the best
+// buy/sell pair inside it. Any window [i,j) of prices is covered by
+// O(log N) nodes, so range min, max and best profit each take O(log N)
+// time instead of a pass over the window. Appending a price updates
+// the O(log N) nodes above it.
+//
+// Summaries are combined left to right: the best pair of two adjacent
+// spans is the best pair of the left span, the pair buying at the left
+// span's minimum and selling at the right span's maximum, or the best
+// pair of the right span, the first of these that is strictly better
+// than the ones before it. That is the same earliest pair
+// stock_set_best() chooses for the whole window.
+
+#include "stock.h"
+
+static stock_range_t range_empty = {-1, -1, -1, -1};
+
+// Combines the summaries of two adjacent spans of 'prices', 'a' to the
+// left of 'b'. Either may be empty.
+static stock_range_t range_merge(double *prices, stock_range_t a, stock_range_t b){
+  if(a.min_index == -1){
+    return b;
+  }
+  if(b.min_index == -1){
+    return a;
+  }
+  stock_range_t r = a;
+  if(prices[b.min_index] < prices[a.min_index]){
+    r.min_index = b.min_index;
+  }
+  if(prices[b.max_index] > prices[a.max_index]){
+    r.max_index = b.max_index;
+  }
+  double best = 0.0;
+  if(a.best_buy != -1){
+    best = prices[a.best_sell] - prices[a.best_buy];
+  }
+  if(prices[b.max_index] - prices[a.min_index] > best){
+    best = prices[b.max_index] - prices[a.min_index];
+    r.best_buy = a.min_index;
+    r.best_sell = b.max_index;
+  }
+  if(b.best_buy != -1 && prices[b.best_sell] - prices[b.best_buy] > best){
+    r.best_buy = b.best_buy;
+    r.best_sell = b.best_sell;
+  }
+  return r;
+}
+
+// Recomputes node 'n' of the index from its two children.
+static void range_pull(stock_t *stock, int n){
+  stock_index_t *index = stock->range_index;
+  index->nodes[n] = range_merge(stock->prices, index->nodes[2 * n], index->nodes[2 * n + 1]);
+}
+
+// (Re)builds the range index of 'stock' over its current prices in
+// O(N) time and attaches it as 'stock->range_index', freeing any index
+// it had. The number of leaves is the next power of two above the
+// current count, so the tree has room to grow and a run of
+// stock_append() calls rebuilds it only each time the count doubles.
+void stock_index_build(stock_t *stock){
+  stock_index_free(stock);
+  int count = stock->count > 0 ? stock->count : 0;
+  stock_index_t *index = malloc(sizeof(stock_index_t));
+  index->size = 1;
+  while(index->size <= count){
+    index->size *= 2;
+  }
+  index->nodes = malloc(sizeof(stock_range_t) * 2 * index->size);
+  stock->range_index = index;
+  for(int i = 0; i < index->size; i++){
+    index->nodes[index->size + i] = range_empty;
+    if(i < count){
+      index->nodes[index->size + i] = (stock_range_t) {i, i, -1, -1};
+    }
+  }
+  for(int n = index->size - 1; n >= 1; n--){
+    range_pull(stock, n);
+  }
+}
+
+// Frees the range index of 'stock', if it has one, and sets
+// 'range_index' to NULL. Called by stock_free().
+void stock_index_free(stock_t *stock){
+  if(stock->range_index != NULL){
+    free(stock->range_index->nodes);
+    free(stock->range_index);
+    stock->range_index = NULL;
+  }
+}
+
+// Adds the price at index 'i', just appended by stock_append(), to the
+// range index of 'stock', updating the nodes above it. If the tree is
+// full it is rebuilt twice as large instead, so appends take O(log N)
+// amortized time.
+void stock_index_append(stock_t *stock, int i){
+  stock_index_t *index = stock->range_index;
+  if(i >= index->size){
+    stock_index_build(stock);
+    return;
+  }
+  int n = index->size + i;
+  index->nodes[n] = (stock_range_t) {i, i, -1, -1};
+  for(n /= 2; n >= 1; n /= 2){
+    range_pull(stock, n);
+  }
+}
+
+// Fills 'range' with the indices of the first minimum, first maximum
+// and best buy/sell pair of the window prices[i..j-1], indices into
+// the whole 'prices' array. Uses the range index of 'stock', building
+// it first if there is none. Returns 0 if the window has a pair with a
+// positive profit and -1 otherwise, in which case 'best_buy' and
+// 'best_sell' are -1 as with stock_set_best(). An empty or out of
+// bounds window sets all four indices to -1 and returns -1.
+int stock_range(stock_t *stock, int i, int j, stock_range_t *range){
+  *range = range_empty;
+  if(i < 0 || j > stock->count || i >= j){
+    return -1;
+  }
+  if(stock->range_index == NULL){
+    stock_index_build(stock);
+  }
+  stock_index_t *index = stock->range_index;
+  stock_range_t left = range_empty, right = range_empty;
+  for(int l = index->size + i, r = index->size + j; l < r; l /= 2, r /= 2){
+    if(l & 1){
+      left = range_merge(stock->prices, left, index->nodes[l++]);
+    }
+    if(r & 1){
+      right = range_merge(stock->prices, index->nodes[--r], right);
+    }
+  }
+  *range = range_merge(stock->prices, left, right);
+  if(range->best_buy == -1){
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,322 @@
+// stock_store.c: columnar store for many stock symbols. Every symbol
+// loaded goes into the same two contiguous columns, times and prices,
+// so analytics over thousands of symbols are one sequential sweep of
+// memory rather than thousands of separately allocated stock_t's.
+
+#include "stock.h"
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Allocates an empty store with no symbols and no rows.
+stock_store_t *stock_store_new(){
+  stock_store_t *store = malloc(sizeof(stock_store_t));
+  store->rows = 0;
+  store->row_cap = 0;
+  store->times = NULL;
+  store->prices = NULL;
+  store->sym_count = 0;
+  store->sym_cap = 0;
+  store->symbols = NULL;
+  store->index_size = 0;
+  store->index = NULL;
+  return store;
+}
+
+// Frees a store along with the names of its symbols and its columns.
+void stock_store_free(stock_store_t *store){
+  for(int s = 0; s < store->sym_count; s++){
+    free(store->symbols[s].name);
+    free(store->symbols[s].data_file);
+  }
+  free(store->symbols);
+  free(store->index);
+  free(store->times);
+  free(store->prices);
+  free(store);
+}
+
+// FNV-1a hash of a symbol name for the store's index.
+static unsigned int symbol_hash(char *name){
+  unsigned int hash = 2166136261u;
+  for(; *name != '\0'; name++){
+    hash = (hash ^ (unsigned char) *name) * 16777619u;
+  }
+  return hash;
+}
+
+// Puts symbol number 's' into the index, which must have a free slot.
+static void index_insert(stock_store_t *store, int s){
+  int mask = store->index_size - 1;
+  int slot = symbol_hash(store->symbols[s].name) & mask;
+  while(store->index[slot] != -1){
+    slot = (slot + 1) & mask;
+  }
+  store->index[slot] = s;
+}
+
+// Returns the symbol with the given name or NULL if there is none.
+// Linear probing through the index; the index is kept at most half
+// full so probes are short.
+stock_symbol_t *stock_store_find(stock_store_t *store, char *name){
+  if(store->index_size == 0){
+    return NULL;
+  }
+  int mask = store->index_size - 1;
+  for(int slot = symbol_hash(name) & mask; store->index[slot] != -1; slot = (slot + 1) & mask){
+    stock_symbol_t *sym = &store->symbols[store->index[slot]];
+    if(strcmp(sym->name, name) == 0){
+      return sym;
+    }
+  }
+  return NULL;
+}
+
+// Returns a heap copy of the symbol name for a data file: the file
+// name without its directory, a leading "stock-" and a trailing ".txt",
+// so data/stock-FB-08-02-2021.txt is symbol FB-08-02-2021.
+static char *symbol_name(char *filename){
+  char *base = strrchr(filename, '/');
+  base = base == NULL ? filename : base + 1;
+  if(strncmp(base, "stock-", 6) == 0 && base[6] != '\0'){
+    base += 6;
+  }
+  int len = strlen(base);
+  if(len > 4 && strcmp(&base[len - 4], ".txt") == 0){
+    len -= 4;
+  }
+  return strndup(base, len);
+}
+
+// Parses the time that starts at '*pos', reading no further than
+// 'end', and advances '*pos' past it. Times like 04:04:00 or 10:00 are
+// hours:minutes[:seconds] and become seconds since midnight; any other
+// token, such as time_07, gives the number at its end. Returns -1 if
+// the token has no digits.
+static int stock_parse_time(char **pos, char *end){
+  char *p = *pos;
+  int total = 0, field = -1, colons = 0;
+  for(; p < end && *p != ' ' && *p != '\t'; p++){
+    if(*p >= '0' && *p <= '9'){
+      field = (field == -1 ? 0 : 10 * field) + (*p - '0');
+    } else if(*p == ':'){
+      total = 60 * total + (field == -1 ? 0 : field);
+      field = -1;
+      colons++;
+    } else{                       // start over after any other character
+      total = 0;
+      field = -1;
+      colons = 0;
+    }
+  }
+  *pos = p;
+  if(colons == 0){
+    return field;
+  }
+  total = 60 * total + (field == -1 ? 0 : field);
+  return colons == 1 ? 60 * total : total;
+}
+
+// Grows the columns of 'store' by doubling until they can take 'more'
+// further rows.
+static void store_reserve(stock_store_t *store, long more){
+  if(store->rows + more <= store->row_cap){
+    return;
+  }
+  while(store->rows + more > store->row_cap){
+    store->row_cap = store->row_cap == 0 ? 1024 : 2 * store->row_cap;
+  }
+  store->times = realloc(store->times, sizeof(int) * store->row_cap);
+  store->prices = realloc(store->prices, sizeof(double) * store->row_cap);
+}
+
+// Adds a symbol covering the last 'count' rows of the columns,
+// growing the symbol array and, to keep it at most half full, the
+// index.
+static void store_add_symbol(stock_store_t *store, char *name, char *filename, int count){
+  if(store->sym_count == store->sym_cap){
+    store->sym_cap = store->sym_cap == 0 ? 16 : 2 * store->sym_cap;
+    store->symbols = realloc(store->symbols, sizeof(stock_symbol_t) * store->sym_cap);
+  }
+  int s = store->sym_count++;
+  stock_symbol_t *sym = &store->symbols[s];
+  sym->name = name;
+  sym->data_file = strdup(filename);
+  sym->first = store->rows - count;
+  sym->count = count;
+  sym->min_index = -1;
+  sym->max_index = -1;
+  sym->best_buy = -1;
+  sym->best_sell = -1;
+  if(2 * store->sym_count > store->index_size){
+    free(store->index);
+    store->index_size = store->index_size == 0 ? 64 : 2 * store->index_size;
+    store->index = malloc(sizeof(int) * store->index_size);
+    for(int i = 0; i < store->index_size; i++){
+      store->index[i] = -1;
+    }
+    for(int i = 0; i < store->sym_count; i++){
+      index_insert(store, i);
+    }
+  } else{
+    index_insert(store, s);
+  }
+}
+
+// Loads one data file, in the format read by stock_load(), as a new
+// symbol at the end of the store. Like stock_load() the file is
+// mapped and the newlines counted first, so the columns grow at most
+// once per file, then each line's time and price are parsed straight
+// into them. Returns 0 on success. If the file cannot be opened,
+// prints a message and returns -1; if a symbol of the same name is
+// already in the store, prints a message, loads nothing and returns
+// -1.
+int stock_store_load_file(stock_store_t *store, char *filename){
+  char *name = symbol_name(filename);
+  if(stock_store_find(store, name) != NULL){
+    printf("Symbol '%s' already loaded, skipping '%s'\n", name, filename);
+    free(name);
+    return -1;
+  }
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  char *map = MAP_FAILED;
+  if(fd != -1 && fstat(fd, &st) == 0){
+    map = st.st_size == 0 ? NULL : mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  if(fd != -1){
+    close(fd);
+  }
+  if(map == MAP_FAILED){
+    printf("Could not open file '%s'\n", filename);
+    free(name);
+    return -1;
+  }
+  char *end = map + st.st_size;
+
+  int lines = 0;
+  for(char *p = map; p < end && (p = memchr(p, '\n', end - p)) != NULL; p++){
+    lines++;
+  }
+  store_reserve(store, lines);
+  int *times = &store->times[store->rows];
+  double *prices = &store->prices[store->rows];
+  char *p = map;
+  for(int i = 0; i < lines; i++){
+    char *eol = memchr(p, '\n', end - p);
+    while(p < eol && (*p == ' ' || *p == '\t')){
+      p++;
+    }
+    times[i] = stock_parse_time(&p, eol);
+    while(p < eol && (*p == ' ' || *p == '\t')){
+      p++;
+    }
+    prices[i] = stock_parse_price(&p, eol);
+    p = eol + 1;
+  }
+  store->rows += lines;
+  if(map != NULL){
+    munmap(map, st.st_size);
+  }
+  store_add_symbol(store, name, filename, lines);
+  return 0;
+}
+
+// Loads every file matching the shell pattern 'pattern', e.g.
+// "data/stock-*.txt", as one symbol each with
+// stock_store_load_file(), in the sorted order glob() gives. A plain
+// file name works as a pattern matching just that file. Returns the
+// number of symbols loaded; if nothing matches, prints a message and
+// returns -1.
+int stock_store_load(stock_store_t *store, char *pattern){
+  glob_t matches;
+  if(glob(pattern, 0, NULL, &matches) != 0){
+    printf("No stock files match '%s'\n", pattern);
+    return -1;
+  }
+  int loaded = 0;
+  for(int i = 0; i < matches.gl_pathc; i++){
+    if(stock_store_load_file(store, matches.gl_pathv[i]) == 0){
+      loaded++;
+    }
+  }
+  globfree(&matches);
+  return loaded;
+}
+
+// Sets 'min_index', 'max_index', 'best_buy' and 'best_sell' of every
+// symbol in one sequential sweep of the price column, with the same
+// results stock_set_minmax() and stock_set_best() give for a stock_t:
+// the earliest minimum and maximum and the earliest buy/sell pair with
+// the best positive profit. The best buy for a sell at 'i' is the
+// earliest minimum before 'i', which is just 'min_index' before it is
+// updated for 'i', so one loop does both jobs.
+void stock_store_analyze(stock_store_t *store){
+  for(int s = 0; s < store->sym_count; s++){
+    stock_symbol_t *sym = &store->symbols[s];
+    double *prices = &store->prices[sym->first];
+    int min = -1, max = -1, buy = -1, sell = -1;
+    double best = 0.0;
+    for(int i = 0; i < sym->count; i++){
+      double price = prices[i];
+      if(min != -1 && price - prices[min] > best){
+        best = price - prices[min];
+        buy = min;
+        sell = i;
+      }
+      if(min == -1 || price < prices[min]){
+        min = i;
+      }
+      if(max == -1 || price > prices[max]){
+        max = i;
+      }
+    }
+    sym->min_index = min;
+    sym->max_index = max;
+    sym->best_buy = buy;
+    sym->best_sell = sell;
+  }
+}
+
+// Fills 'view' with a stock_t for symbol 'sym' whose 'prices' point
+// into the store's price column, so that stock_print(), stock_plot()
+// and the other stock_t functions can be used on a single symbol
+// without copying it. The view borrows its arrays from the store: it
+// must not be passed to stock_free() or stock_load() and is invalid
+// once more files are loaded into the store. A range index built for
+// the view must be freed with stock_index_free(). stock_append() on a
+// view first copies its prices, which the caller must then free().
+void stock_store_view(stock_store_t *store, stock_symbol_t *sym, stock_t *view){
+  view->data_file = sym->data_file;
+  view->count = sym->count;
+  view->prices = &store->prices[sym->first];
+  view->min_index = sym->min_index;
+  view->max_index = sym->max_index;
+  view->best_buy = sym->best_buy;
+  view->best_sell = sym->best_sell;
+  view->capacity = 0;
+  view->run_min = -1;
+  view->range_index = NULL;
+}
+
+// Prints one line per symbol with its number of prices, its analytics
+// indices and the profit of its best buy/sell pair, as in
+//
+// symbol                count   min   max   buy  sell     profit
+// FB-08-02-2021           543   470    15   109   129       2.38
+void stock_store_print(stock_store_t *store){
+  printf("%-20s %6s %5s %5s %5s %5s %10s\n",
+         "symbol", "count", "min", "max", "buy", "sell", "profit");
+  for(int s = 0; s < store->sym_count; s++){
+    stock_symbol_t *sym = &store->symbols[s];
+    double *prices = &store->prices[sym->first];
+    double profit = 0.0;
+    if(sym->best_buy != -1){
+      profit = prices[sym->best_sell] - prices[sym->best_buy];
+    }
+    printf("%-20s %6d %5d %5d %5d %5d %10.2f\n", sym->name, sym->count,
+           sym->min_index, sym->max_index, sym->best_buy, sym->best_sell, profit);
+  }
+}
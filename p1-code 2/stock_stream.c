@@ -0,0 +1,221 @@
+// stock_stream.c: sliding window analytics over a stream of prices.
+// A stock_stream_t sees prices one at a time and keeps, for the most
+// recent 'window' of them, the minimum, maximum, best buy/sell pair
+// and moving averages. Each push takes O(1) amortized time and the
+// memory used depends only on the window, never on how many prices
+// have gone by, so a stream can follow a live feed indefinitely.
+//
+// Minimum, maximum and best pair are kept with a two-stack queue of
+// window summaries (stock_window_t). Combining the summaries of two
+// adjacent runs of prices is associative, as in the range index of
+// stock_range.c, so the window is split into an older part and a newer
+// part:
+//
+// - the newer part is one running summary, extended by every push;
+// - the older part is a stack holding, for each of its prices, the
+//   summary from that price through to the end of the older part, so
+//   dropping the oldest price is a pop and the top is the summary of
+//   the whole older part.
+//
+// When the older part runs out, the newer part is turned into a new
+// older part by one backwards pass over its prices. Each price is
+// moved once, so pushes are O(1) amortized. The window's summary is the
+// older part's combined with the newer part's.
+
+#include "stock.h"
+#include <unistd.h>
+
+static stock_window_t window_empty = {-1, -1, -1, -1, 0.0, 0.0, 0.0};
+
+// Summary of the single price 'price' seen at time 't'.
+static stock_window_t window_single(long t, double price){
+  stock_window_t w = {t, t, -1, -1, price, price, 0.0};
+  return w;
+}
+
+// Combines the summaries of two adjacent runs of prices, 'a' before
+// 'b', with the same earliest-first tie-breaking as stock_set_minmax()
+// and stock_set_best().
+static stock_window_t window_merge(stock_window_t a, stock_window_t b){
+  if(a.min_t == -1){
+    return b;
+  }
+  if(b.min_t == -1){
+    return a;
+  }
+  stock_window_t r = a;
+  if(b.min < a.min){
+    r.min_t = b.min_t;
+    r.min = b.min;
+  }
+  if(b.max > a.max){
+    r.max_t = b.max_t;
+    r.max = b.max;
+  }
+  if(b.max - a.min > r.profit){
+    r.buy_t = a.min_t;
+    r.sell_t = b.max_t;
+    r.profit = b.max - a.min;
+  }
+  if(b.buy_t != -1 && b.profit > r.profit){
+    r.buy_t = b.buy_t;
+    r.sell_t = b.sell_t;
+    r.profit = b.profit;
+  }
+  return r;
+}
+
+// Allocates a stream over windows of the last 'window' prices, which
+// must be at least 1.
+stock_stream_t *stock_stream_new(int window){
+  stock_stream_t *stream = malloc(sizeof(stock_stream_t));
+  stream->window = window;
+  stream->seen = 0;
+  stream->ring = malloc(sizeof(double) * window);
+  stream->older = malloc(sizeof(stock_window_t) * window);
+  stream->older_len = 0;
+  stream->newer = window_empty;
+  stream->newer_len = 0;
+  stream->sum = 0.0;
+  stream->ema = 0.0;
+  return stream;
+}
+
+// Frees a stream and its buffers.
+void stock_stream_free(stock_stream_t *stream){
+  free(stream->ring);
+  free(stream->older);
+  free(stream);
+}
+
+// Turns the newer part of the window into the older part, which must
+// be empty: walks its prices from newest to oldest, pushing the
+// summary from each price to the newest onto the 'older' stack.
+static void stream_flip(stock_stream_t *stream){
+  stock_window_t suffix = window_empty;
+  for(long t = stream->seen - 1; t >= stream->seen - stream->newer_len; t--){
+    suffix = window_merge(window_single(t, stream->ring[t % stream->window]), suffix);
+    stream->older[stream->older_len++] = suffix;
+  }
+  stream->newer = window_empty;
+  stream->newer_len = 0;
+}
+
+// Adds the next price of the stream. Once the window is full the
+// oldest price leaves it. Updates the window summary, the moving
+// average and the exponential moving average, whose smoothing factor
+// is 2/(window+1) so it weighs recent prices about like the window.
+// The running sum behind the moving average is recomputed from the
+// window every 'window' pushes so that rounding errors from adding
+// and removing prices cannot build up.
+void stock_stream_push(stock_stream_t *stream, double price){
+  long t = stream->seen;
+  int slot = t % stream->window;
+  if(t >= stream->window){                // evict price t-window, in 'slot'
+    if(stream->older_len == 0){
+      stream_flip(stream);
+    }
+    stream->older_len--;
+    stream->sum -= stream->ring[slot];
+  }
+  stream->ring[slot] = price;
+  stream->sum += price;
+  stream->newer = window_merge(stream->newer, window_single(t, price));
+  stream->newer_len++;
+  stream->seen++;
+  if(slot == stream->window - 1){
+    stream->sum = 0.0;
+    for(int i = 0; i < stream->window; i++){
+      stream->sum += stream->ring[i];
+    }
+  }
+  if(t == 0){
+    stream->ema = price;
+  } else{
+    double alpha = 2.0 / (stream->window + 1);
+    stream->ema += alpha * (price - stream->ema);
+  }
+}
+
+// Fills 'w' with the summary of the current window: the times, counted
+// from 0 for the first price pushed, and prices of its first minimum
+// and maximum, and of its best buy/sell pair with that pair's profit.
+// Times are -1 where there is no such price or no profitable pair.
+// Returns the number of prices in the window.
+int stock_stream_window(stock_stream_t *stream, stock_window_t *w){
+  stock_window_t older = window_empty;
+  if(stream->older_len > 0){
+    older = stream->older[stream->older_len - 1];
+  }
+  *w = window_merge(older, stream->newer);
+  return stream->older_len + stream->newer_len;
+}
+
+// Returns the simple moving average of the prices in the window, or
+// 0.0 if no price has been pushed.
+double stock_stream_sma(stock_stream_t *stream){
+  int n = stream->older_len + stream->newer_len;
+  return n == 0 ? 0.0 : stream->sum / n;
+}
+
+// Reads "time price" lines (or bare prices) from 'in' and pushes each
+// price to 'stream', printing a line with the window's analytics after
+// each one as in
+//
+//      t time        price      min      max      sma      ema    buy   sell   profit
+//      3 time_04    168.00   103.00   250.00   164.67   158.97      0      1   147.00
+//
+// where buy/sell are the times of the best pair in the window. Lines
+// without a price are skipped. At the end of 'in', returns if 'follow'
+// is 0 and otherwise waits for more lines to be written, as tail -f
+// does, so a growing file can be followed. Output is flushed after
+// each line when following or reading standard input so that a live
+// feed shows up as it arrives. Only the current line is held in
+// memory.
+void stock_stream_run(stock_stream_t *stream, FILE *in, int follow){
+  char line[256];
+  printf("%6s %-10s %8s %8s %8s %8s %8s %6s %6s %8s\n",
+         "t", "time", "price", "min", "max", "sma", "ema", "buy", "sell", "profit");
+  while(1){
+    if(fgets(line, sizeof(line), in) == NULL){
+      if(!follow){
+        return;
+      }
+      clearerr(in);
+      usleep(100000);
+      continue;
+    }
+    char time[64] = "-", *end = line + strlen(line);
+    char *p = line;
+    while(p < end && (*p == ' ' || *p == '\t')){
+      p++;
+    }
+    char *token = p;
+    while(p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r'){
+      p++;
+    }
+    char *after = p;
+    while(p < end && (*p == ' ' || *p == '\t')){
+      p++;
+    }
+    if(p < end && *p != '\n' && *p != '\r'){   // two tokens: time and price
+      snprintf(time, sizeof(time), "%.*s", (int) (after - token), token);
+    } else{                                     // one token: a bare price
+      p = token;
+    }
+    char *start = p;
+    double price = stock_parse_price(&p, end);
+    if(p == start){
+      continue;
+    }
+    stock_stream_push(stream, price);
+    stock_window_t w;
+    stock_stream_window(stream, &w);
+    printf("%6ld %-10s %8.2f %8.2f %8.2f %8.2f %8.2f %6ld %6ld %8.2f\n",
+           stream->seen - 1, time, price, w.min, w.max, stock_stream_sma(stream),
+           stream->ema, w.buy_t, w.sell_t, w.profit);
+    if(follow || in == stdin){
+      fflush(stdout);
+    }
+  }
+}
@@ -384,6 +384,41 @@ int main(int argc, char *argv[]){
     stock_print(&stock1);
   } // ENDTEST
 
+  else if( strcmp( test_name, "stock_set_minmax4" )==0 ) {
+    PRINT_TEST;
+    // Checks stock_set_minmax() on length 2 arrays and that repeated
+    // minimum/maximum prices give the index of their first occurrence,
+    // including in an array long enough to use the vector kernels
+    double prices2[2] = {50.0, 50.0};
+    stock_t stock2 = {
+      .data_file = "2prices.txt",
+      .count = 2,
+      .prices = prices2,
+      .min_index = -1,
+      .max_index = -1,
+      .best_buy  = -1,
+      .best_sell = -1,
+    };
+    stock_set_minmax(&stock2);
+    printf("equal pair min_index: %d max_index: %d\n", stock2.min_index, stock2.max_index);
+
+    double prices40[40];
+    for(int i = 0; i < 40; i++){
+      prices40[i] = 20.0 + (i * 7 + 3) % 11;  // 20.00 to 30.00, each repeated
+    }
+    stock_t stock40 = {
+      .data_file = "40prices.txt",
+      .count = 40,
+      .prices = prices40,
+      .min_index = -1,
+      .max_index = -1,
+      .best_buy  = -1,
+      .best_sell = -1,
+    };
+    stock_set_minmax(&stock40);
+    stock_print(&stock40);
+  } // ENDTEST
+
   else if( strcmp( test_name, "stock_set_best1" )==0 ) {
   {
     PRINT_TEST;
@@ -506,6 +541,92 @@ int main(int argc, char *argv[]){
     stock_print(&stock);
   } // ENDTEST
 
+  else if( strcmp( test_name, "stock_set_best5" )==0 ) {
+    PRINT_TEST;
+    // Checks that among several buy/sell pairs with the same maximal
+    // profit the earliest one is chosen: 1,3 and 1,6 and 4,6 all give
+    // a profit of 20.00 so best_buy/best_sell should be 1,3
+    double prices[8] = {
+      30.0, 10.0, 20.0, 30.0, 10.0,
+      25.0, 30.0, 15.0,
+    };
+    stock_t stock = {
+      .data_file = "prices.txt",
+      .count = 8,
+      .prices = prices,
+      .min_index = -1,
+      .max_index = -1,
+      .best_buy  = -1,
+      .best_sell = -1,
+    };
+    int ret = stock_set_best(&stock);
+    stock_set_minmax(&stock);
+    printf("ret: %d\n", ret);
+    stock_print(&stock);
+  } // ENDTEST
+
+  else if( strcmp( test_name, "stock_append" )==0 ) {
+    PRINT_TEST;
+    // Builds a stock one price at a time with stock_append() and checks
+    // that min/max and best buy/sell are kept up to date after each
+    // price, ending with the same answer stock_set_best() gives.
+    double prices[10] = {
+      50.0, 40.0, 45.0, 20.0, 35.0,
+      60.0, 20.0, 25.0, 70.0, 10.0,
+    };
+    stock_t *stock = stock_new();
+    stock->data_file = strdup("appended");
+    for(int i = 0; i < 10; i++){
+      int ret = stock_append(stock, prices[i]);
+      printf("append %5.2f ret: %2d min: %d max: %d buy: %2d sell: %2d\n",
+             prices[i], ret, stock->min_index, stock->max_index,
+             stock->best_buy, stock->best_sell);
+    }
+    int ret = stock_set_best(stock);
+    printf("stock_set_best ret: %d\n", ret);
+    stock_print(stock);
+    stock_free(stock);
+  } // ENDTEST
+
+  else if( strcmp( test_name, "stock_append_borrowed" )==0 ) {
+    PRINT_TEST;
+    // Appends to stocks whose prices are not their own: a caller's
+    // array and a view into a store. stock_append() must copy them to
+    // the heap first and leave the borrowed prices, including the
+    // store's next symbol, unchanged. The caller's stock leaves
+    // 'run_min' at 0, so the analytics must still be computed from
+    // scratch since 'min_index' is -1.
+    double prices[3] = {30.0, 10.0, 20.0};
+    stock_t stock = {
+      .data_file = "borrowed.txt",
+      .count = 3,
+      .prices = prices,
+      .min_index = -1,
+      .max_index = -1,
+      .best_buy  = -1,
+      .best_sell = -1,
+    };
+    int ret = stock_append(&stock, 40.0);
+    printf("ret: %d\n", ret);
+    stock_print(&stock);
+    printf("caller's prices: %.2f %.2f %.2f\n", prices[0], prices[1], prices[2]);
+    free(stock.prices);
+
+    stock_store_t *store = stock_store_new();
+    stock_store_load(store, "data/stock-1only.txt");
+    stock_store_load(store, "data/stock-2only.txt");
+    stock_t view;
+    stock_store_view(store, &store->symbols[0], &view);
+    ret = stock_append(&view, 99.0);
+    printf("ret: %d\n", ret);
+    stock_print(&view);
+    free(view.prices);
+    stock_symbol_t *next = &store->symbols[1];
+    printf("%s: %.2f %.2f\n", next->name, store->prices[next->first],
+           store->prices[next->first + 1]);
+    stock_store_free(store);
+  } // ENDTEST
+
   else if( strcmp( test_name, "count_lines" )==0 ) {
   {
     PRINT_TEST;
@@ -605,6 +726,24 @@ int main(int argc, char *argv[]){
     stock_free(stock);
   } // ENDTEST
 
+  else if( strcmp( test_name, "stock_load_again" )==0 ) {
+    PRINT_TEST;
+    // Loads and analyzes one stock, then loads a shorter stock into the
+    // same struct. The analytics of the first must not carry over, so
+    // appending to the second recomputes them for its own prices.
+    stock_t *stock = stock_new();
+    stock_load(stock, "data/stock-jagged.txt");
+    stock_set_minmax(stock);
+    stock_set_best(stock);
+    int ret = stock_load(stock, "data/stock-2only.txt");
+    printf("ret: %d\n", ret);
+    stock_print(stock);
+    ret = stock_append(stock, 1.0);
+    printf("stock_append ret: %d\n", ret);
+    stock_print(stock);
+    stock_free(stock);
+  } // ENDTEST
+
   else if( strcmp( test_name, "stock_plot1" )==0 ) {
     PRINT_TEST;
     // Plots a stock with a small prices array that is NOT loaded from
@@ -708,6 +847,105 @@ int main(int argc, char *argv[]){
     stock_free(stock);
   } // ENDTEST
 
+  else if( strcmp( test_name, "stock_range" )==0 ) {
+    PRINT_TEST;
+    // Builds a range index over a loaded stock and checks range
+    // min/max/best queries on several windows [i,j), including
+    // empty and out of bounds ones, then appends prices and checks
+    // that the index answers for the longer series.
+    stock_t *stock = stock_new();
+    stock_load(stock, "data/stock-jagged.txt");
+    stock_index_build(stock);
+    int windows[][2] = {{0,15}, {0,4}, {2,8}, {9,15}, {12,15}, {5,6}, {4,4}, {-1,3}, {3,16}};
+    for(int w = 0; w < 9; w++){
+      stock_range_t range;
+      int ret = stock_range(stock, windows[w][0], windows[w][1], &range);
+      printf("[%2d,%2d) ret: %2d min: %2d max: %2d buy: %2d sell: %2d\n",
+             windows[w][0], windows[w][1], ret, range.min_index,
+             range.max_index, range.best_buy, range.best_sell);
+    }
+    for(int i = 0; i < 20; i++){
+      stock_append(stock, 500.0 - 10.0 * i);
+    }
+    stock_append(stock, 600.0);
+    stock_range_t range;
+    int ret = stock_range(stock, 10, stock->count, &range);
+    printf("[10,%d) ret: %2d min: %2d max: %2d buy: %2d sell: %2d\n", stock->count,
+           ret, range.min_index, range.max_index, range.best_buy, range.best_sell);
+    stock_free(stock);
+  } // ENDTEST
+
+  else if( strcmp( test_name, "stock_store" )==0 ) {
+    PRINT_TEST;
+    // Loads several symbols into one columnar store, by pattern and by
+    // plain file name, then checks the analytics of all symbols, lookup
+    // by name, the time column and a stock_t view of one symbol.
+    stock_store_t *store = stock_store_new();
+    int ret = stock_store_load(store, "data/stock-*only.txt");
+    printf("ret: %d\n", ret);
+    ret = stock_store_load(store, "data/stock-jagged.txt");
+    printf("ret: %d\n", ret);
+    ret = stock_store_load(store, "data/stock-2only.txt");
+    printf("ret: %d\n", ret);
+    printf("sym_count: %d rows: %ld\n", store->sym_count, store->rows);
+    stock_store_analyze(store);
+    stock_store_print(store);
+
+    stock_symbol_t *sym = stock_store_find(store, "3only");
+    printf("3only first: %ld times: [%d, %d, %d]\n", sym->first,
+           store->times[sym->first], store->times[sym->first + 1],
+           store->times[sym->first + 2]);
+    printf("not-there found: %d\n", stock_store_find(store, "not-there") != NULL);
+
+    stock_t view;
+    stock_store_view(store, stock_store_find(store, "jagged"), &view);
+    stock_print(&view);
+    stock_store_free(store);
+  } // ENDTEST
+
+  else if( strcmp( test_name, "stock_stream" )==0 ) {
+    PRINT_TEST;
+    // Pushes prices through a stream with a window of 4 and checks the
+    // window's min/max, best buy/sell times, moving average and count
+    // after each push, including pushes after which the minimum, the
+    // maximum or the best pair has left the window.
+    double prices[] = {103, 250, 133, 143, 168, 91, 234, 59, 38, 45, 254, 270};
+    stock_stream_t *stream = stock_stream_new(4);
+    for(int i = 0; i < 12; i++){
+      stock_stream_push(stream, prices[i]);
+      stock_window_t w;
+      int n = stock_stream_window(stream, &w);
+      printf("t: %2ld n: %d min: %2ld %6.2f max: %2ld %6.2f buy: %2ld sell: %2ld profit: %6.2f sma: %6.2f\n",
+             stream->seen - 1, n, w.min_t, w.min, w.max_t, w.max,
+             w.buy_t, w.sell_t, w.profit, stock_stream_sma(stream));
+    }
+    stock_stream_free(stream);
+  } // ENDTEST
+
+  else if( strcmp( test_name, "stock_plot_rows" )==0 ) {
+    PRINT_TEST;
+    // Plots the 15 prices from the stock_plot() comments with room for
+    // 4 rows, so each row covers a bucket of 4 prices and the last one
+    // the 3 left over, then with room for 6 and for all 15 prices, the
+    // latter being the same as stock_plot().
+    double prices[15] = {223, 292, 27, 92, 323, 189, 207, 142,
+                         321, 89, 14, 182, 164, 156, 169};
+    stock_t stock = {
+      .data_file = "d-data-file.txt",
+      .count = 15,
+      .prices = prices,
+      .min_index = 10,
+      .max_index = 4,
+      .best_buy  = 2,
+      .best_sell = 4,
+    };
+    stock_plot_rows(&stock, 25, 4);
+    printf("\n");
+    stock_plot_rows(&stock, 25, 6);
+    printf("\n");
+    stock_plot_rows(&stock, 25, 15);
+  } // ENDTEST
+
 //     double prices[10] = {
 // 358.99, 358.70, 358.58, 358.25, 358.00, 358.23, 358.19,
 // 358.26, 358.19, 358.23, 358.22, 358.40, 358.40, 358.47,